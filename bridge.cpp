@@ -0,0 +1,1470 @@
+#include <stdio.h>
+#include <cstdint>
+#include <cstring>
+
+#include "hal.h"
+#include "bridge.h"
+#include "status.h"
+#include "cache.h"
+#include "ijsched.h"
+#include "rules.h"
+#include "trace.h"
+#include "stats.h"
+#include "net.h"
+
+
+/* Both interception queues are committed together, ic1 is published first */
+ic_queue buf_ic0;
+ic_queue buf_ic1;
+ijreq_queue buf_ijreq;
+ijres_queue buf_ijres;
+
+uint8_t buf_tmp_usb_data[BUF_LEN];
+struct sysex_buffer buf_tmp_usb = {buf_tmp_usb_data, BUF_LEN};
+int16_t usb_tmp_pos = 0;                // bytes of buf_tmp_usb already queued
+bool usb_midi_open = false;             // USB-MIDI frame partially queued in buf_ijreq
+
+/* USB client transmit path: ijres frames gathered into one write */
+struct usb_tx {
+	uint8_t buf[USB_TX_LEN];
+	int16_t len;
+	int16_t pos;                    // bytes already written
+	int16_t off;                    // bytes of the front ijres frame already in buf
+} usb_tx[2];                            // CLIENT_MIDI, CLIENT_RAW
+uint8_t ijres_sent = 0;                 // CLIENT_BIT of paths holding the whole front ijres frame
+uint32_t ic_loans_done = 0;             // loaned ic frames sent, not yet released
+bool ic_echoed = false;                 // front ic pair logged, waiting for its loans
+
+uint8_t raw_rx_data[RAW_FRAME_MAX];     // vendor interface frame being received
+uint8_t raw_rx_hdr[RAW_HDR];
+uint16_t raw_rx_len;
+uint16_t raw_rx_pos = 0;                // bytes of the header and the frame received
+
+uint8_t net_rx_data[NET_DGRAM_MAX];     // received datagram
+struct net_rx net_rx;
+bool net_rx_pending = false;            // net_rx holds frames not queued yet
+struct net_seq net_seq_rx;
+uint8_t net_tx_data[NET_DGRAM_MAX];     // datagram being filled or sent
+struct net_tx net_tx;
+uint16_t net_tx_len = 0;                // datagram waiting for hal_net_send
+uint16_t net_seq_tx = 0;
+
+
+struct status_model status;             // core1 only
+struct resp_cache cache;                // core1 only
+struct ij_sched sched;                  // core1 only
+struct rule_table rules;                // core1 only
+
+/* Frames of each stream to a client, core1 only */
+struct stream_seq {
+	uint16_t seq[STREAMS];          // sequence number of the next frame
+	uint16_t lost[STREAMS];         // frames lost, not reported yet
+	uint16_t lost_seq[STREAMS];     // sequence number of the first of them
+} streams[CLIENTS];
+uint16_t tx_seq[CLIENTS][STREAMS];      // core0: seq of the next frame sent, in step with streams
+
+struct cap_ring cap[2];
+
+struct trace_ring trace;                // core0 only
+uint16_t trace_err = 0;                 // last err_get() reported in the trace
+struct trace_ring rec;                  // raw capture, filled by core1
+bool rec_on = false;                    // core1: recording started
+uint32_t rec_pos;                       // core1: capture position recorded so far
+uint8_t rec_pins[2];                    // core1: pins in the last TRACE_PIN record
+struct trace_ring *drain_ring = &trace; // core0: ring being drained
+uint32_t drain_end;                     // core0: record boundary where the drain switches rings
+
+uint8_t pins = TRACE_PIN_NIRQB;         // core1: TRACE_PIN_ levels driven by the injection
+uint8_t pins_mux = 0;                   // core1: HAL_MUX_ selects
+
+uint64_t ij_holdoff;                    // injection is enabled after this time at the latest
+bool ij_inited = false;
+uint64_t ready_t0;                      // core1: bridge_init
+uint64_t ready_idle;                    // core1: nIRQ1 idle since
+uint64_t ready_probe_next;              // core1
+struct sched_slot ready_probe;          // core1: status request probing the CPB
+volatile uint8_t ready_by = READY_NONE; // READY_ cause
+uint32_t ready_us;                      // time from bridge_init to ready
+uint64_t t_loop = 0;                    // core1: start of the last loop iteration (RT_EN)
+bool core1_idle = false;                // core1: nothing captured, injected or queued
+bool ic_stalled = false;                // core1: captured bytes wait for a free ic frame
+
+
+bool do_echo_fw = false;
+bool do_echo_usb = false;
+bool do_trace = false;                  // log as binary trace records instead of text
+volatile bool do_record = false;        // record raw capture and pins into the trace stream
+volatile uint8_t rules_presets = RULES_FILTER_STATUS;  // RULES_FILTER_ of the default rules
+volatile bool rules_reset = false;      // presets changed by core0, applied by core1
+volatile uint8_t ic_route = 0;          // CLIENT_BIT of clients monitoring the interception, core1 writes
+volatile bool ic_route_midi = false;    // console i/I by core0, applied to ic_route by core1
+volatile bool ic_route_sync = false;
+bool do_cache = true;                   // answer cacheable requests from the shadow copy
+
+volatile uint16_t r_err[2] = {0, 0};    // sticky ERR_ bits of core0 and core1, read by err_get
+volatile bool err_reset = false;        // request from core0, done by core1
+
+struct bridge_stats stats;
+volatile bool stats_reset = false;      // request from core0, done by core1
+
+
+const char *ready_name(uint8_t by)
+{
+	switch (by) {
+	case READY_NATIVE:
+		return "native";
+	case READY_PROBE:
+		return "probe";
+	case READY_TIMEOUT:
+		return "timeout";
+	}
+	return "no";
+}
+
+/* Injection is enabled from now on (core1) */
+void ij_ready(uint8_t by)
+{
+	if (ij_inited)
+		return;
+	ready_us = hal_time_us() - ready_t0;
+	ready_by = by;
+	ij_inited = true;
+}
+
+void printbuf(uint8_t buf[], size_t len)
+{
+	size_t i;
+	for (i = 0; i < len; ++i) {
+		if (i % PRINTBUF_BPL == PRINTBUF_BPL -1)
+			printf("%02x\n", buf[i]);
+		else
+			printf("%02x ", buf[i]);
+	}
+
+	if (i % PRINTBUF_BPL) {
+		putchar('\n');
+	}
+}
+
+/* Sticky error bit for the console, count for the statistics.
+ * Each core has its own word and counters, set_err is for core1.
+ */
+void HAL_RAM_FUNC(set_err)(uint16_t e)
+{
+	r_err[1] |= e;
+	stats.err[1][__builtin_ctz(e)]++;
+}
+
+void set_err0(uint16_t e)
+{
+	r_err[0] |= e;
+	stats.err[0][__builtin_ctz(e)]++;
+}
+
+uint16_t err_get()
+{
+	return r_err[0] | r_err[1];
+}
+
+/* Pin changes of the injection, the shadow is recorded by rec_sync */
+void HAL_RAM_FUNC(mux_sel)(uint8_t mux, bool inject)
+{
+	if (inject)
+		pins_mux |= mux;
+	else
+		pins_mux &= ~mux;
+	hal_mux_sel(mux, inject);
+}
+
+void HAL_RAM_FUNC(irqb_put)(bool v)
+{
+	if (v)
+		pins |= TRACE_PIN_NIRQB;
+	else
+		pins &= ~TRACE_PIN_NIRQB;
+	hal_irqb_put(v);
+}
+
+/* Record the captured bytes and pin changes since the last call (core1) */
+void HAL_RAM_FUNC(rec_sync)()
+{
+	uint32_t w = cap[0].wr;
+	uint32_t n, off;
+	uint32_t ts = hal_time_us();
+	uint8_t p[2];
+
+	if ((int32_t)(cap[1].wr - w) < 0)
+		w = cap[1].wr;
+
+	if (!rec_on) {
+		rec_on = true;
+		rec_pos = w;
+		rec_pins[0] = 0xFF;
+	}
+
+	p[0] = pins | (hal_irq1_get() ? TRACE_PIN_NIRQ1 : 0);
+	p[1] = pins_mux;
+	if (p[0] != rec_pins[0] || p[1] != rec_pins[1]) {
+		trace_put(&rec, TRACE_PIN, ts, p, sizeof(p));
+		rec_pins[0] = p[0];
+		rec_pins[1] = p[1];
+	}
+
+	/* Overwritten meanwhile: the capture counts it as lost */
+	if (w - rec_pos > CAP_RING_LEN)
+		rec_pos = w - CAP_RING_LEN;
+
+	while (rec_pos != w) {
+		off = rec_pos & CAP_RING_MASK;
+		n = w - rec_pos;
+		if (n > CAP_RING_LEN - off)
+			n = CAP_RING_LEN - off;
+		if (n > REC_CHUNK_MAX)
+			n = REC_CHUNK_MAX;
+		trace_put2(&rec, TRACE_RAW, ts, cap[0].buf + off, n, cap[1].buf + off, n);
+		rec_pos += n;
+	}
+}
+
+/* Sample progress of both capture rings, return count of byte pairs ready */
+uint32_t HAL_RAM_FUNC(cap_sync)()
+{
+	uint8_t i;
+	uint32_t avail[2];
+	uint32_t rd;
+	uint32_t lost = cap[0].lost + cap[1].lost;
+
+	for (i = 0; i < 2; i++) {
+		avail[i] = cap_update(&cap[i], hal_cap_wr(i));
+	}
+
+	/* Each ring skips its own overrun: resync both to the later read position,
+	 * so the byte pairs stay at equal offsets
+	 */
+	if (lost != cap[0].lost + cap[1].lost) {
+		rd = (int32_t)(cap[1].rd - cap[0].rd) > 0 ? cap[1].rd : cap[0].rd;
+		for (i = 0; i < 2; i++) {
+			cap[i].lost += rd - cap[i].rd;
+			cap[i].rd = rd;
+			if ((int32_t)(cap[i].wr - rd) < 0)
+				cap[i].wr = rd;
+			avail[i] = cap_avail(&cap[i]);
+		}
+		set_err(ERR_CAP_OVERRUN);
+	}
+
+	return avail[0] < avail[1] ? avail[0] : avail[1];
+}
+
+uint8_t HAL_RAM_FUNC(cap_read)(uint8_t n)
+{
+	return cap_getc(&cap[n]);
+}
+
+/* Returns false when there is no command */
+bool read_uart_cmd()
+{
+	int c;
+
+	c = hal_getchar();
+	if (c < 0)
+		return false;
+
+	if (c == 'h' || c == '?') {
+		printf(
+				"StudioLive 16.0.2 SPI-USB control bridge\n"
+				"Help\n"
+				"f/F: enable/disable logging of FireWire messages\n"
+				"u/U: enable/disable logging of USB-MIDI messages (shortlog)\n"
+				"t/T: enable/disable binary trace instead of text log\n"
+				"r/R: enable/disable recording of raw SPI capture into the binary trace\n"
+				"q/Q: enable/disable filtering out all request messages (resets the rules, see F0 7D 40)\n"
+				"s/S: enable/disable filtering out status reqest/response messages (resets the rules)\n"
+				"i/I: enable/disable routing intercepted messages to USB-MIDI (see F0 7D 13)\n"
+				"k/K: enable/disable answering requests from the cache\n"
+				"c/C: print/clear status and error registers\n"
+				"l/L: print/clear latency histograms, queue high-water marks and error counts\n"
+		);
+	} else if (c == 'f') {
+		do_echo_fw = true;
+		printf("Echo FireWire on\n");
+	} else if (c == 'F') {
+		do_echo_fw = false;
+		printf("Echo FireWire off\n");
+	} else if (c == 'u') {
+		do_echo_usb = true;
+		printf("Echo USB on\n");
+	} else if (c == 'U') {
+		do_echo_usb = false;
+		printf("Echo USB off\n");
+	} else if (c == 't') {
+		printf("Binary trace on\n");
+		do_trace = true;
+	} else if (c == 'T') {
+		do_trace = false;
+		printf("Binary trace off\n");
+	} else if (c == 'r') {
+		do_record = true;
+	} else if (c == 'R') {
+		do_record = false;
+	} else if (c == 'S') {
+		rules_presets &= ~RULES_FILTER_STATUS;
+		rules_reset = true;
+	} else if (c == 's') {
+		rules_presets |= RULES_FILTER_STATUS;
+		rules_reset = true;
+	} else if (c == 'Q') {
+		rules_presets &= ~RULES_FILTER_REQUEST;
+		rules_reset = true;
+	} else if (c == 'q') {
+		rules_presets |= RULES_FILTER_REQUEST;
+		rules_reset = true;
+	} else if (c == 'i') {
+		ic_route_midi = true;
+		ic_route_sync = true;
+	} else if (c == 'I') {
+		ic_route_midi = false;
+		ic_route_sync = true;
+	} else if (c == 'k') {
+		do_cache = true;
+	} else if (c == 'K') {
+		do_cache = false;
+	} else if (c == 'l') {
+		stats_print(&stats);
+	} else if (c == 'L') {
+		stats_clear(&stats, 0);
+		stats_reset = true;
+	} else if (c == 'C') {
+		r_err[0] = 0;
+		err_reset = true;
+	} else if (c == 'c') {
+		printf("Errors: %04x\n", err_get());
+		printf("WR ptrs (IC, IJREQ, IJRES): %02lx %02lx %02lx\n", (unsigned long)buf_ic0.wr_index(),
+				(unsigned long)buf_ijreq.wr_index(), (unsigned long)buf_ijres.wr_index());
+		printf("RD ptrs (IC, IJREQ, IJRES): %02lx %02lx %02lx\n", (unsigned long)buf_ic0.rd_index(),
+				(unsigned long)buf_ijreq.rd_index(), (unsigned long)buf_ijres.rd_index());
+		printf("Capture lost (SPI0, SPI1): %lu %lu\n", (unsigned long)cap[0].lost, (unsigned long)cap[1].lost);
+		printf("Cache hits/misses: %lu %lu\n", (unsigned long)cache.hits, (unsigned long)cache.misses);
+		printf("Inject coalesced/aged: %lu %lu\n", (unsigned long)sched.coalesced, (unsigned long)sched.aged);
+		printf("Ready: %s, after %lu us\n", ready_name(ready_by), (unsigned long)ready_us);
+		printf("Trace dropped (log, record): %lu %lu\n", (unsigned long)trace.dropped_total,
+				(unsigned long)rec.dropped_total);
+	}
+	hal_barrier();
+	return true;
+}
+
+/* Frames handed over to core0, which may sleep in hal_wait */
+void HAL_RAM_FUNC(ijres_publish)()
+{
+	buf_ijres.publish();
+	hal_notify();
+}
+
+/* Number the frame, a lost one is reported by lost_flush */
+void HAL_RAM_FUNC(stream_next)(uint8_t clients, uint8_t stream, bool queued)
+{
+	uint8_t c;
+	struct stream_seq *q;
+
+	for (c = 0; c < CLIENTS; c++) {
+		if (!(clients & CLIENT_BIT(c)))
+			continue;
+		q = &streams[c];
+		if (!queued) {
+			if (!q->lost[stream])
+				q->lost_seq[stream] = q->seq[stream];
+			q->lost[stream]++;
+			stats.lost[stream]++;
+		}
+		q->seq[stream] = (q->seq[stream] + 1) & 0x3FFF;
+	}
+}
+
+/* Frame of the stream queued to the clients, or lost */
+void HAL_RAM_FUNC(stream_count)(uint8_t clients, uint8_t stream, bool queued)
+{
+	if (!queued && clients)
+		set_err(ERR_IJRES_BUF_NOTREADY);
+	stream_next(clients, stream, queued);
+}
+
+/* Report the lost frames to the clients before any other frame,
+ * false while the reports do not fit
+ */
+bool HAL_RAM_FUNC(lost_flush)(uint8_t clients)
+{
+	uint8_t c, i;
+	struct stream_seq *q;
+	struct sysex_buffer *d;
+
+	for (c = 0; c < CLIENTS; c++) {
+		if (!(clients & CLIENT_BIT(c)))
+			continue;
+		q = &streams[c];
+		for (i = 0; i < STREAMS; i++) {
+			if (!q->lost[i])
+				continue;
+			d = buf_ijres.claim(9);
+			if (!d)
+				return false;
+			d->buf[0] = 0xF0;
+			d->buf[1] = BRIDGE_SYSEX_ID;
+			d->buf[2] = BRIDGE_CMD_LOST;
+			d->buf[3] = i;
+			d->buf[4] = q->lost_seq[i] & 0x7F;
+			d->buf[5] = q->lost_seq[i] >> 7;
+			d->buf[6] = q->lost[i] & 0x7F;
+			d->buf[7] = (q->lost[i] >> 7) & 0x7F;
+			d->buf[8] = 0xF7;
+			d->len = 9;
+			d->ts = hal_time_us();
+			d->clients = CLIENT_BIT(c);
+			d->stream = STREAM_NONE;
+			buf_ijres.commit();
+			q->lost[i] = 0;
+		}
+	}
+	return true;
+}
+
+/* A frame of the stream may be queued to the clients: the lost ones are reported,
+ * the responses may use the reserve of buf_ijres, the other streams not
+ */
+bool HAL_RAM_FUNC(ijres_admit)(uint8_t clients, uint8_t stream)
+{
+	if (stream != STREAM_RES && buf_ijres.count() >= buf_ijres.depth() - buf_ijres.depth() / IJRES_RESERVE)
+		return false;
+	return lost_flush(clients);
+}
+
+/* Subscribed status fields changed: send them to each subscribed client,
+ * a client missing a delta gets all its fields next time
+ */
+void HAL_RAM_FUNC(status_complete)(struct sysex_buffer *ic0)
+{
+	uint8_t c;
+	uint64_t changed, mask;
+	struct sysex_buffer *ijres;
+
+	changed = status_update(&status, ic0);
+	for (c = 0; c < CLIENTS; c++) {
+		mask = status_client_mask(&status, c, changed);
+		if (!mask)
+			continue;
+
+		ijres = ijres_admit(CLIENT_BIT(c), STREAM_DELTA) ? buf_ijres.claim(STATUS_DELTA_MAX) : nullptr;
+		stream_count(CLIENT_BIT(c), STREAM_DELTA, ijres);
+		if (!ijres) {
+			status.snap |= CLIENT_BIT(c);
+			continue;
+		}
+		ijres->len = status_delta(&status, mask, ijres->buf, ijres->size);
+		ijres->ts = ic0->ts;
+		ijres->clients = CLIENT_BIT(c);
+		ijres->stream = STREAM_DELTA;
+		buf_ijres.commit();
+	}
+	ijres_publish();
+}
+
+/* Intercepted frame to the monitoring clients: loaned while the ic queues
+ * have room for it, copied otherwise. Returns true when loaned.
+ */
+bool HAL_RAM_FUNC(ic_route_frame)(struct sysex_buffer *s, uint8_t to, bool loan)
+{
+	struct sysex_buffer *ijres;
+
+	if (!ijres_admit(to, STREAM_MON)) {
+		ijres = nullptr;
+	} else if (loan) {
+		ijres = buf_ijres.loan(s);
+	} else if ((ijres = buf_ijres.claim(s->len)) != nullptr) {
+		memcpy(ijres->buf, s->buf, s->len);
+		ijres->len = s->len;
+		ijres->ts = s->ts;
+	}
+	stream_count(to, STREAM_MON, ijres);
+	if (!ijres)
+		return false;
+	ijres->clients = to;
+	ijres->stream = STREAM_MON;
+	if (!loan)
+		buf_ijres.commit();
+	return loan;
+}
+
+/* Intercepted transaction is complete: route it to the monitoring clients
+ * and hand over to core0
+ */
+void HAL_RAM_FUNC(ic_complete)()
+{
+	struct sysex_buffer *ic0 = buf_ic0.claim();
+	struct sysex_buffer *ic1 = buf_ic1.claim();
+	uint64_t now = hal_time_us();
+	uint8_t to = ic_route;
+	bool loan;
+
+	ic0->ts = now;
+	ic1->ts = now;
+	ic0->loans = 0;
+	ic0->act = rules_apply(&rules, RULE_RES, ic0);
+	ic1->act = buf_full(ic1) ? rules_apply(&rules, RULE_REQ, ic1) : RULE_DROP;
+
+	/* Subscribed clients get deltas instead of the whole status */
+	if (is_status_res(ic0)) {
+		to &= ~status_subscribers(&status);
+		status_complete(ic0);
+	}
+
+	if (buf_full(ic1)) {
+		cache_update(&cache, ic1, ic0, rules_cacheable(&rules, ic1), now);
+		ij_ready(READY_NATIVE);
+	}
+
+	if (to && ((ic0->act | ic1->act) & RULE_ROUTE)) {
+		/* Loaned frames stay in the ic queues until sent, keep half of them for the capture */
+		loan = buf_ic0.count() < buf_ic0.depth() / 2 && buf_ic1.count() < buf_ic1.depth() / 2;
+		if ((ic1->act & RULE_ROUTE) && ic_route_frame(ic1, to, loan))
+			ic0->loans++;
+		if ((ic0->act & RULE_ROUTE) && ic_route_frame(ic0, to, loan))
+			ic0->loans++;
+		ijres_publish();
+	}
+
+	/* Nothing for core0: the frames are reused */
+	if (!do_echo_fw) {
+		ic0->act &= ~RULE_LOG;
+		ic1->act &= ~RULE_LOG;
+	}
+	if (!ic0->loans && !((ic0->act | ic1->act) & RULE_LOG)) {
+		buf_clear(ic0);
+		buf_clear(ic1);
+		return;
+	}
+
+	buf_ic1.commit();
+	buf_ic0.commit();
+	buf_ic1.publish();
+	buf_ic0.publish();
+	hal_notify();
+}
+
+/* Bridge control message from a client */
+void bridge_ctl(struct sysex_buffer *req)
+{
+	uint8_t c = __builtin_ctz(req->clients);
+
+	switch (req->buf[2]) {
+	case BRIDGE_CMD_SUBSCRIBE:
+		status_subscribe(&status, c, req);
+		break;
+	case BRIDGE_CMD_SNAPSHOT:
+		status.snap |= req->clients;
+		break;
+	case BRIDGE_CMD_MONITOR:
+		if (req->len >= 5 && req->buf[3])
+			ic_route |= req->clients;
+		else if (req->len >= 5)
+			ic_route &= ~req->clients;
+		break;
+	case BRIDGE_CMD_RULE:
+		rules_load(&rules, req);
+		break;
+	case BRIDGE_CMD_RULES_RESET:
+		rules_init(&rules, rules_presets);
+		break;
+	}
+}
+
+/* Answer the request from the cache. A write of the value already set is
+ * answered too, unless a pending request may change the parameter first.
+ */
+bool HAL_RAM_FUNC(cache_answer)(struct sysex_buffer *req)
+{
+	const struct cache_entry *e;
+	struct sysex_buffer *ijres;
+	uint64_t now = hal_time_us();
+
+	if (cache_is_write(req) ? sched_foreground(&sched) : !rules_cacheable(&rules, req))
+		return false;
+	e = cache_get(&cache, req, now);
+	if (!e)
+		return false;
+
+	ijres = lost_flush(req->clients) ? buf_ijres.claim(e->res_len) : nullptr;
+	if (!ijres)
+		return false;
+	memcpy(ijres->buf, e->res, e->res_len);
+	ijres->len = e->res_len;
+	ijres->ts = now;
+	ijres->clients = req->clients;
+	ijres->stream = STREAM_RES;
+	buf_ijres.commit();
+	ijres_publish();
+	stream_count(req->clients, STREAM_RES, true);
+	return true;
+}
+
+/* Move the queued requests to the scheduler,
+ * bridge control messages and cache hits are consumed here
+ */
+void HAL_RAM_FUNC(ijreq_pull)()
+{
+	int ret;
+	bool uncached;
+	struct sysex_buffer *s, req;
+
+	while ((s = buf_ijreq.front()) != nullptr) {
+		req = *s;
+		uncached = is_bridge_ctl(s) && s->buf[2] == BRIDGE_CMD_UNCACHED && s->len >= 5;
+		if (uncached) {
+			/* Unwrapped view: F0 7D 20 <cmd> ... F7 -> F0 <cmd> ... F7 */
+			req.buf += 2;
+			req.len -= 2;
+			req.buf[0] = 0xF0;
+		}
+
+		if (!uncached && is_bridge_ctl(&req)) {
+			bridge_ctl(&req);
+		} else if (uncached || !do_cache || !cache_answer(&req)) {
+			ret = sched_put(&sched, &req, uncached);
+			if (ret == RET_ERR_BUF_FULL) {
+				/* Stays queued for the next try */
+				if (uncached)
+					s->buf[2] = BRIDGE_CMD_UNCACHED;
+				return;
+			}
+			if (ret == RET_ERR_BUF_OVERFLOW)
+				set_err(ERR_BUF_OVERFLOW);
+		}
+		buf_clear(s);
+		buf_ijreq.release();
+		hal_notify();
+	}
+}
+
+/* Injection state machine, advanced by core1_main one step per iteration,
+ * so the interception keeps running until the bus is taken over.
+ */
+enum ij_state {
+	IJ_IDLE,
+	IJ_DRAIN,               // nIRQ0 held, interception takes the rest of the rings
+	IJ_PUSH,                // request bytes pushed, one per echoed byte
+	IJ_AWAIT,               // response
+};
+
+struct ij_ctx {
+	uint8_t state;
+	uint8_t burst;          // back-to-back requests while DSPB stays idle
+	int16_t pos;            // request bytes written to the SPI TX
+	int16_t echo;           // request bytes clocked out
+	int ret;
+	uint64_t to;
+	uint64_t t0, t1, t2;
+	struct sched_slot *slot;
+	struct sysex_buffer *req;
+	struct sysex_buffer *res;
+} ij;
+
+/* Scheduled request to inject next */
+bool HAL_RAM_FUNC(ij_pick)()
+{
+	ijreq_pull();
+	ij.slot = sched_next(&sched, hal_time_us());
+	ij.req = ij.slot ? &ij.slot->req : nullptr;
+	return ij.req;
+}
+
+/* Leave the request scheduled for later */
+void HAL_RAM_FUNC(ij_unpick)()
+{
+	ij.slot->busy = false;
+	ij.slot = nullptr;
+	ij.req = nullptr;
+}
+
+/* The same response for each write replaced by the injected one */
+void HAL_RAM_FUNC(ij_dups)(const struct sysex_buffer *res)
+{
+	uint16_t i;
+	struct sysex_buffer *d;
+
+	for (i = 0; i < ij.slot->dups; i++) {
+		d = ijres_admit(res->clients, STREAM_RES) ? buf_ijres.claim(res->len) : nullptr;
+		stream_count(res->clients, STREAM_RES, d);
+		if (!d)
+			continue;
+		memcpy(d->buf, res->buf, res->len);
+		d->len = res->len;
+		d->ts = res->ts;
+		d->clients = res->clients;
+		d->stream = STREAM_RES;
+		buf_ijres.commit();
+	}
+}
+
+/* Request is answered (or failed): hand the response over to core0 */
+void HAL_RAM_FUNC(ij_finish)()
+{
+	uint64_t now = hal_time_us();
+	uint16_t i;
+
+	if (ij.state >= IJ_PUSH) {
+		irqb_put(1);
+		mux_sel(HAL_MUX_NSS1 | HAL_MUX_MISO0, 0);
+
+		hist_add(&stats.tr_drain, ij.t1 - ij.t0);
+		hist_add(&stats.tr, now - ij.t0);
+	}
+
+	if (ij.res) {
+		ij.res->ts = now;
+		ij.res->clients = ij.req->clients;
+		ij.res->stream = STREAM_RES;
+		if (ij.ret == 0)
+			cache_update(&cache, ij.req, ij.res, rules_cacheable(&rules, ij.req), now);
+		else
+			cache_invalidate(&cache);
+		if (ij.res->len) {
+			buf_ijres.commit();
+			stream_count(ij.res->clients, STREAM_RES, true);
+			ij_dups(ij.res);
+		} else {
+			/* No response (timeout): lost for the request and its dups, reported by F0 7D 14 */
+			buf_clear(ij.res);
+			for (i = 0; i <= ij.slot->dups; i++)
+				stream_next(ij.res->clients, STREAM_RES, false);
+		}
+		ijres_publish();
+
+		if (ij.slot == &ready_probe && ij.ret == 0 && is_status_res(ij.res))
+			ij_ready(READY_PROBE);
+	}
+	hist_add(&stats.ij, (uint32_t)now - ij.req->ts);
+
+	sched_done(&sched, ij.slot);
+
+	ij.slot = nullptr;
+	ij.req = nullptr;
+	ij.res = nullptr;
+	ij.state = IJ_DRAIN;
+}
+
+/* Next request of the burst, or release the bus */
+void HAL_RAM_FUNC(ij_next)()
+{
+	if (ij_inited && ++ij.burst < IJ_BURST && hal_irq1_get() == 1 && ij_pick()) {
+		ij.t0 = hal_time_us();
+		ij.state = IJ_DRAIN;
+		return;
+	}
+	mux_sel(HAL_MUX_NIRQ0, 0);
+	ij.state = IJ_IDLE;
+}
+
+/* Take over the bus: rings are drained, the CPB sees the injected nIRQ0 */
+void HAL_RAM_FUNC(ij_start)()
+{
+	struct sysex_buffer *req = ij.req;
+	int16_t len = req->len;
+
+	/* Error: no SOF/EOF in SysEx */
+	if (req->buf[0] != 0xF0)
+		set_err(ERR_NO_F0);
+	if (req->buf[len-1] != 0xF7)
+		set_err(ERR_NO_F7);
+	if (req->buf[0] != 0xF0 || req->buf[len-1] != 0xF7) {
+		ij.ret = RET_ERR_FORMAT;
+		ij_finish();
+		ij_next();
+		return;
+	}
+
+	ij.res = lost_flush(ij.req->clients) ? buf_ijres.claim() : nullptr;
+	if (!ij.res) {
+		/* Try again later, the bus is released meanwhile */
+		mux_sel(HAL_MUX_NIRQ0, 0);
+		ij_unpick();
+		ij.state = IJ_IDLE;
+		return;
+	}
+
+	mux_sel(HAL_MUX_NSS1 | HAL_MUX_MISO0, 1);
+
+	/* Need read too for FIFO cleanup */
+	cap_sync();
+	cap_consume(&cap[0], cap_avail(&cap[0]));
+	cap_consume(&cap[1], cap_avail(&cap[1]));
+
+	irqb_put(0);
+
+	ij.t1 = hal_time_us();
+	ij.to = ij.t1 + 1000000;
+	ij.pos = 0;
+	ij.echo = 0;
+	ij.ret = 0;
+	ij.state = IJ_PUSH;
+}
+
+void HAL_RAM_FUNC(ij_push)(uint32_t n)
+{
+	struct sysex_buffer *req = ij.req;
+
+	/* One byte in flight: write the next one after its predecessor is clocked */
+	if (ij.pos == ij.echo && ij.pos < req->len && hal_spi_writable(HAL_SPI_CPB))
+		hal_spi_write(HAL_SPI_CPB, req->buf[ij.pos++]);
+
+	if (n && ij.echo < ij.pos) {
+		cap_read(0);
+		cap_read(1);
+		ij.echo++;
+	}
+
+	if (ij.echo == req->len) {
+		/* INFO: Maybe too early here: deassert when the response starts */
+		irqb_put(1);
+		ij.t2 = hal_time_us();
+		hist_add(&stats.tr_push, ij.t2 - ij.t1);
+		ij.to = ij.t2 + 1000000;
+		ij.state = IJ_AWAIT;
+	} else if (!n && (int64_t)(hal_time_us() - ij.to) > 0) {
+		ij.ret = RET_ERR_TIMEOUT;
+		ij_finish();
+		ij_next();
+	}
+}
+
+void HAL_RAM_FUNC(ij_await)(uint32_t n)
+{
+	uint8_t in;
+	struct sysex_buffer *res = ij.res;
+
+	if (!n) {
+		if ((int64_t)(hal_time_us() - ij.to) > 0) {
+			/* Expected from the readiness probe */
+			if (ij_inited)
+				set_err(ERR_RESP_TIMEOUT);
+			ij.ret = RET_ERR_TIMEOUT;
+			ij_finish();
+			ij_next();
+		}
+		return;
+	}
+
+	for (; n && res->len == 0; n--) {
+		cap_read(1);
+		in = cap_read(0);
+
+		if (res->pos == 1 && in == 0) {
+			set_err(ERR_NULL_STATUS);
+			continue;
+		}
+		if (res->pos == res->size)
+			ij.res = res = buf_ijres.grow(res);
+		if (buf_append(res, in) == RET_ERR_BUF_OVERFLOW)
+			set_err(ERR_BUF_OVERFLOW);
+	}
+
+	if (res->len) {
+		hist_add(&stats.tr_wait, hal_time_us() - ij.t2);
+		ij_finish();
+		ij_next();
+	}
+}
+
+/* No transaction on the bus, none half captured */
+bool HAL_RAM_FUNC(ic_idle)(struct sysex_buffer *ic0, struct sysex_buffer *ic1, uint32_t n)
+{
+	/* A complete request in ic1 is still waiting for the Master response */
+	return !(n || (ic0 && !buf_cleared(ic0)) || (ic1 && (!buf_cleared(ic1) || buf_full(ic1))));
+}
+
+/* Take over the bus for the picked request, false when DSPB wants it */
+bool HAL_RAM_FUNC(ij_take)()
+{
+	if (hal_irq1_get() == 0) {
+		ij_unpick();
+		return false;
+	}
+
+	/* Paranoia */
+	mux_sel(HAL_MUX_NIRQ0, 1);
+	if (hal_irq1_get() == 0) {
+		mux_sel(HAL_MUX_NIRQ0, 0);
+		ij_unpick();
+		return false;
+	}
+	ij.burst = 0;
+	ij.t0 = hal_time_us();
+	ij.state = IJ_DRAIN;
+	return true;
+}
+
+/* One step of the injection, n is count of captured byte pairs ready */
+void HAL_RAM_FUNC(ij_step)(struct sysex_buffer *ic0, struct sysex_buffer *ic1, uint32_t n)
+{
+	switch (ij.state) {
+	case IJ_IDLE:
+		if (ic_idle(ic0, ic1, n) && ij_pick())
+			ij_take();
+		break;
+
+	case IJ_DRAIN:
+		/* Interception frames what is left, unless its queue is full */
+		if (n && ic0 && ic1)
+			break;
+		ij_start();
+		break;
+
+	case IJ_PUSH:
+		ij_push(n);
+		break;
+
+	case IJ_AWAIT:
+		ij_await(n);
+		break;
+	}
+}
+
+/* Enable injecting requests after DSPB init: the DSPB init shows in
+ * the requests from the FW chip, but when Pico reboots by software request
+ * on the fly, there are no such requests. Then a status request is injected
+ * while the DSPB stays idle, injection is enabled when the CPB answers it.
+ * The hold-off timeout is the fallback.
+ */
+void ij_wait_ready(struct sysex_buffer *ic0, struct sysex_buffer *ic1, uint32_t n)
+{
+	static const uint8_t probe[] = {0xF0, 0x38, 0x03, 0xF7};
+	uint64_t now = hal_time_us();
+
+	if (ij.state != IJ_IDLE) {
+		ij_step(ic0, ic1, n);
+		return;
+	}
+	if ((int64_t)(now - ij_holdoff) > 0) {
+		ij_ready(READY_TIMEOUT);
+		return;
+	}
+
+	if (hal_irq1_get() == 0)
+		ready_idle = now;
+	if (now - ready_idle < READY_IDLE_US || (int64_t)(now - ready_probe_next) < 0 || !ic_idle(ic0, ic1, n))
+		return;
+	ready_probe_next = now + READY_PROBE_US;
+
+	memcpy(ready_probe.req.buf, probe, sizeof(probe));
+	ready_probe.req.pos = ready_probe.req.len = sizeof(probe);
+	ready_probe.req.ts = now;
+	ready_probe.req.clients = 0;
+	ready_probe.busy = true;
+	ij.slot = &ready_probe;
+	ij.req = &ready_probe.req;
+	ij_take();
+}
+
+void HAL_RAM_FUNC(core1_main)()
+{
+	uint32_t n;
+	uint32_t len;
+	const uint8_t *p0, *p1;
+	bool stalled;
+
+	uint64_t now;
+
+	struct sysex_buffer *ic0, *ic1;
+
+	do {
+#if RT_EN
+		/* Worst case of the capture polling period, the sleeps not counted */
+		now = hal_time_us();
+		if (t_loop && !core1_idle)
+			hist_add(&stats.loop, now - t_loop);
+		t_loop = now;
+#endif
+		if (stats_reset) {
+			stats_clear(&stats, 1);
+			stats_reset = false;
+		}
+		if (err_reset) {
+			r_err[1] = 0;
+			err_reset = false;
+		}
+		if (rules_reset) {
+			rules_preset(&rules, rules_presets);
+			rules_reset = false;
+		}
+		/* Cleared first: a toggle meanwhile is applied on the next pass */
+		if (ic_route_sync) {
+			ic_route_sync = false;
+			if (ic_route_midi)
+				ic_route |= CLIENT_BIT(CLIENT_MIDI);
+			else
+				ic_route &= ~CLIENT_BIT(CLIENT_MIDI);
+		}
+		hwm_update(&stats.hwm_ic, buf_ic0.count());
+		hwm_update(&stats.hwm_ijres, buf_ijres.count());
+
+		/* NULL when the interception ring is full */
+		ic0 = buf_ic0.claim();
+		ic1 = buf_ic1.claim();
+
+		n = cap_sync();
+		if (do_record)
+			rec_sync();
+		else
+			rec_on = false;
+		hwm_update(&stats.hwm_cap, n);
+
+		/* Whole chunks: the rings stay in lockstep, so the offsets are equal.
+		 * While a request is pushed or awaited, the bytes belong to the injection.
+		 */
+		if (n && ic0 && ic1 && ij.state < IJ_PUSH) {
+			/* The shorter of the contiguous chunks, they can differ at the ring end */
+			len = n;
+			p0 = cap_peek(&cap[0], &len);
+			p1 = cap_peek(&cap[1], &len);
+
+			/* Response from Master completes the transaction */
+			len = queue_append_chunk(buf_ic0, ic0, p0, len);
+			queue_append_chunk(buf_ic1, ic1, p1, len);
+			cap_consume(&cap[0], len);
+			cap_consume(&cap[1], len);
+
+			if (buf_full(ic0)) {
+				now = hal_time_us();
+				ic_complete();
+				hist_add(&stats.ic, hal_time_us() - now);
+			}
+			continue;
+		}
+		/* Otherwise the bytes wait in the rings until core0 frees a slot */
+		stalled = n && !(ic0 && ic1) && ij.state < IJ_PUSH;
+		if (stalled && !ic_stalled)
+			set_err(ERR_IC_BUF_NOTREADY);
+		ic_stalled = stalled;
+
+		if (!ij_inited) {
+			ijreq_pull();
+			ij_wait_ready(ic0, ic1, n);
+		} else {
+			ij_step(ic0, ic1, n);
+		}
+
+		/* Sleep until the bus or core0 has something, the readiness probe runs on time */
+		core1_idle = ij_inited && ij.state == IJ_IDLE && ic_idle(ic0, ic1, n) && !buf_ijreq.count();
+#if MC_EN && WAIT_EN
+		if (core1_idle) {
+			now = hal_time_us();
+			hal_wait(now + WAIT_MAX_US, true);
+			stats.idle[1] += hal_time_us() - now;
+		}
+#endif
+	} while (MC_EN);
+}
+
+void bridge_init()
+{
+	cap_init(&cap[0], hal_cap_buf(HAL_SPI_CPB));
+	cap_init(&cap[1], hal_cap_buf(HAL_SPI_DSPB));
+
+	buf_clear(&buf_tmp_usb);
+	net_seq_init(&net_seq_rx);
+	net_tx_begin(&net_tx, net_tx_data, sizeof(net_tx_data), net_seq_tx);
+	status_init(&status);
+	cache_init(&cache);
+	rules_init(&rules, rules_presets);
+	sched_init(&sched);
+	trace_init(&trace);
+	trace_init(&rec);
+	stats_clear(&stats, 0);
+	stats_clear(&stats, 1);
+	ij.state = IJ_IDLE;
+	ready_probe.req.buf = ready_probe.data;
+	ready_probe.req.size = SCHED_REQ_MAX;
+	ready_t0 = hal_time_us();
+	ready_idle = ready_t0;
+	ready_probe_next = ready_t0;
+	ij_holdoff = ready_t0 + READY_MAX_US;
+	hal_barrier();
+}
+
+/* Drain the trace rings to the host, as much as fits.
+ * The rings are switched only at a record boundary.
+ * Returns true when anything was written.
+ */
+bool trace_drain()
+{
+	uint32_t n;
+	const uint8_t *p;
+
+	if (drain_ring->rd.load(std::memory_order_relaxed) == drain_end) {
+		drain_ring = drain_ring == &trace ? &rec : &trace;
+		drain_end = drain_ring->wr.load(std::memory_order_acquire);
+	}
+
+	n = drain_end - drain_ring->rd.load(std::memory_order_relaxed);
+	if (!n)
+		return false;
+	p = trace_peek(drain_ring, &n);
+	n = hal_trace_write(p, n);
+	trace_consume(drain_ring, n);
+	return n > 0;
+}
+
+/* The front ijres frame is on the way to the client */
+void ijres_done(struct sysex_buffer *s)
+{
+	if (do_echo_usb && do_trace)
+		trace_put(&trace, TRACE_M2U, s->ts, s->buf, s->len);
+	else if (do_echo_usb)
+		printf("M2U %d, %d/%d\n", s->len, s->invalid_pre, s->invalid_post);
+
+	if (s->loans)
+		ic_loans_done++;
+	buf_clear(s);
+	buf_ijres.release();
+}
+
+/* Queue a whole request frame from the vendor interface or the network,
+ * never in the middle of a USB-MIDI one. Returns false when there is no space.
+ */
+bool ijreq_put(const uint8_t *msg, uint16_t len, uint8_t from)
+{
+	struct sysex_buffer *s;
+
+	if (usb_midi_open)
+		return false;
+	s = buf_ijreq.claim(len);
+	if (!s)
+		return false;
+
+	memcpy(s->buf, msg, len);
+	s->pos = s->len = len;
+	s->invalid_pre = s->invalid_post = 0;
+	s->ts = hal_time_us();
+	s->clients = CLIENT_BIT(from);
+	if (do_echo_usb && do_trace)
+		trace_put(&trace, TRACE_U2M, s->ts, s->buf, s->len);
+	else if (do_echo_usb)
+		printf("U2M %d\n", s->len);
+	buf_ijreq.commit();
+	return true;
+}
+
+/* Tag of the frame to the client: its stream and seq in the stream */
+uint16_t tx_tag(uint8_t c, const struct sysex_buffer *s)
+{
+	return FRAME_TAG(s->stream, s->stream < STREAMS ? tx_seq[c][s->stream] : 0);
+}
+
+/* The frame is out to the client, a LOST notice skips the lost frames */
+void tx_count(uint8_t c, const struct sysex_buffer *s)
+{
+	if (s->stream < STREAMS)
+		tx_seq[c][s->stream] = FRAME_TAG_SEQ(tx_seq[c][s->stream] + 1);
+	else if (s->len == 9 && s->buf[1] == BRIDGE_SYSEX_ID && s->buf[2] == BRIDGE_CMD_LOST && s->buf[3] < STREAMS)
+		tx_seq[c][s->buf[3]] = FRAME_TAG_SEQ((s->buf[4] | s->buf[5] << 7) + (s->buf[6] | s->buf[7] << 7));
+}
+
+/* Copy as much of the frame as fits into the USB write, every write
+ * flushes the TX FIFO, a lone short frame would take a whole IN packet.
+ * The vendor interface gets each frame prefixed with its length and tag.
+ * Returns true when the whole frame is in.
+ */
+bool usb_tx_put(struct usb_tx *t, const struct sysex_buffer *s, bool raw, uint16_t tag)
+{
+	int16_t n;
+
+	if (t->pos == t->len)
+		t->pos = t->len = 0;
+	if (raw && t->off == 0) {
+		if (USB_TX_LEN - t->len <= RAW_HDR)
+			return false;
+		t->buf[t->len++] = s->len;
+		t->buf[t->len++] = s->len >> 8;
+		t->buf[t->len++] = tag;
+		t->buf[t->len++] = tag >> 8;
+	}
+	n = s->len - t->off;
+	if (n > USB_TX_LEN - t->len)
+		n = USB_TX_LEN - t->len;
+	memcpy(t->buf + t->len, s->buf + t->off, n);
+	t->len += n;
+	t->off += n;
+	if (t->off != s->len)
+		return false;
+	t->off = 0;
+	return true;
+}
+
+/* Add the frame to the datagram, false while it has to wait for the send */
+bool net_tx_frame(const struct sysex_buffer *s, uint16_t tag)
+{
+	if (net_tx_len)
+		return false;
+	if (net_tx_put(&net_tx, s->buf, s->len, tag))
+		return true;
+	if (net_tx.frames) {
+		net_tx_len = net_tx.len;
+		return false;
+	}
+	/* Larger than a datagram */
+	set_err0(ERR_BUF_OVERFLOW);
+	return true;
+}
+
+/* Hand the ready ijres frames over to the transmit paths of their clients,
+ * a frame is released when all of them have it. Returns true when any was.
+ */
+bool ijres_route()
+{
+	struct sysex_buffer *s;
+	uint8_t c;
+	bool done;
+	bool released = false;
+
+	while ((s = buf_ijres.front()) != nullptr) {
+		for (c = 0; c < CLIENTS; c++) {
+			if (!(s->clients & CLIENT_BIT(c)) || (ijres_sent & CLIENT_BIT(c)))
+				continue;
+			if (c == CLIENT_NET)
+				done = net_tx_frame(s, tx_tag(c, s));
+			else
+				done = usb_tx_put(&usb_tx[c], s, c == CLIENT_RAW, tx_tag(c, s));
+			if (done) {
+				ijres_sent |= CLIENT_BIT(c);
+				tx_count(c, s);
+			}
+		}
+		if (s->clients & ~ijres_sent)
+			return released;
+		ijres_sent = 0;
+		ijres_done(s);
+		released = true;
+	}
+	return released;
+}
+
+/* Vendor interface: frames of LE16 length, LE16 tag (unused) and raw SysEx. Returns true
+ * when a frame was queued or dropped, false when waiting for more data
+ * or for space in buf_ijreq.
+ */
+bool raw_rx_frame()
+{
+	uint16_t off, n;
+
+	if (raw_rx_pos < RAW_HDR) {
+		raw_rx_pos += hal_raw_read(raw_rx_hdr + raw_rx_pos, RAW_HDR - raw_rx_pos);
+		if (raw_rx_pos < RAW_HDR)
+			return false;
+		raw_rx_len = raw_rx_hdr[0] | raw_rx_hdr[1] << 8;
+	}
+
+	/* Oversized frames are read over and dropped */
+	while (raw_rx_pos - RAW_HDR < raw_rx_len) {
+		off = (raw_rx_pos - RAW_HDR) % RAW_FRAME_MAX;
+		n = raw_rx_len - (raw_rx_pos - RAW_HDR);
+		if (n > RAW_FRAME_MAX - off)
+			n = RAW_FRAME_MAX - off;
+		n = hal_raw_read(raw_rx_data + off, n);
+		if (n == 0)
+			return false;
+		raw_rx_pos += n;
+	}
+
+	if (raw_rx_len == 0 || raw_rx_len > RAW_FRAME_MAX) {
+		set_err0(ERR_BUF_OVERFLOW);
+		raw_rx_pos = 0;
+		return true;
+	}
+
+	if (!ijreq_put(raw_rx_data, raw_rx_len, CLIENT_RAW))
+		return false;
+	raw_rx_pos = 0;
+	return true;
+}
+
+/* Network: queue the frames of the received datagrams,
+ * returns the count of queued frames.
+ */
+int16_t net_rx_task()
+{
+	struct net_rx r;
+	const uint8_t *m;
+	uint16_t len, seq, tag;
+	int16_t n = 0;
+
+	for (;;) {
+		if (!net_rx_pending) {
+			len = hal_net_recv(net_rx_data, sizeof(net_rx_data));
+			if (len == 0)
+				return n;
+			if (!net_rx_begin(&net_rx, net_rx_data, len, &seq) || !net_seq_check(&net_seq_rx, seq))
+				continue;
+			net_rx_pending = true;
+		}
+
+		r = net_rx;
+		if (!net_rx_next(&net_rx, &m, &len, &tag)) {
+			net_rx_pending = false;
+			continue;
+		}
+		if (len == 0 || len > RAW_FRAME_MAX) {
+			set_err0(ERR_BUF_OVERFLOW);
+			continue;
+		}
+		if (!ijreq_put(m, len, CLIENT_NET)) {
+			net_rx = r;
+			return n;
+		}
+		n++;
+	}
+}
+
+/* Network: the routed frames in one datagram, retried until sent */
+void net_tx_task()
+{
+	if (net_tx_len == 0 && net_tx.frames)
+		net_tx_len = net_tx.len;
+	if (net_tx_len && hal_net_send(net_tx_data, net_tx_len)) {
+		net_tx_len = 0;
+		net_tx_begin(&net_tx, net_tx_data, sizeof(net_tx_data), ++net_seq_tx);
+	}
+}
+
+/* One pass of the core0 routing loop */
+void bridge_task()
+{
+	int16_t i;
+	int16_t len;
+	uint8_t c;
+	uint8_t d[2];
+	bool more;
+
+	struct sysex_buffer *s, *s0;
+	struct usb_tx *t;
+	uint64_t now;
+	bool busy;
+
+	hal_task();
+	busy = read_uart_cmd();
+#if (!MC_EN)
+	core1_main();
+#endif
+
+	/* Pull intercept streams (both streams are input, synchronized) and print,
+	 * core1 queues only the pairs to log or loaned to the clients
+	 */
+	s0 = buf_ic0.front();
+	if (s0 && !ic_echoed) {
+		s = buf_ic1.front();
+		if (s->act & RULE_LOG) {
+			if (do_trace) {
+				trace_put(&trace, TRACE_F2M, s->ts, s->buf, s->len);
+			} else {
+				printf("F2M %d, %d/%d :", s->len, s->invalid_pre, s->invalid_post);
+				printbuf(s->buf, s->len < PRINTBUF_MAX? s->len : PRINTBUF_MAX);
+			}
+		}
+		buf_clear(s);
+
+		s = s0;
+		if (s->act & RULE_LOG) {
+			if (do_trace) {
+				trace_put(&trace, TRACE_M2F, s->ts, s->buf, s->len);
+			} else {
+				printf("M2F %d, %d/%d: ", s->len, s->invalid_pre, s->invalid_post);
+				printbuf(s->buf, s->len < PRINTBUF_MAX ? s->len : PRINTBUF_MAX);
+			}
+		}
+		buf_clear(s);
+		ic_echoed = true;
+		busy = true;
+	}
+
+	/* The pair is released after its frames loaned to the clients are sent */
+	if (s0 && ic_loans_done >= s0->loans) {
+		ic_loans_done -= s0->loans;
+		ic_echoed = false;
+		buf_ic1.release();
+		buf_ic0.release();
+		busy = true;
+	}
+
+	/* Push inject stream readen from USB-MIDI,
+	 * the remainder waits in buf_tmp_usb until the queue has space.
+	 */
+	if (usb_tmp_pos == buf_tmp_usb.len) {
+		buf_tmp_usb.len = hal_midi_read(buf_tmp_usb.buf, BUF_LEN);
+		usb_tmp_pos = 0;
+		busy |= buf_tmp_usb.len > 0;
+	}
+	i = 0;
+	while (usb_tmp_pos < buf_tmp_usb.len && (s = buf_ijreq.claim()) != nullptr) {
+		usb_tmp_pos += queue_append_chunk(buf_ijreq, s, buf_tmp_usb.buf + usb_tmp_pos,
+				buf_tmp_usb.len - usb_tmp_pos);
+		usb_midi_open = !buf_full(s) && !buf_cleared(s);
+		if (buf_full(s)) {
+			s->ts = hal_time_us();
+			s->clients = CLIENT_BIT(CLIENT_MIDI);
+			if (do_echo_usb && do_trace)
+				trace_put(&trace, TRACE_U2M, s->ts, s->buf, s->len);
+			else if (do_echo_usb)
+				printf("U2M %d, %d/%d\n", s->len, s->invalid_pre, s->invalid_post);
+			buf_ijreq.commit();
+			i++;
+		}
+	}
+	while (raw_rx_frame())
+		i++;
+	i += net_rx_task();
+	if (i) {
+		buf_ijreq.publish();
+		hwm_update(&stats.hwm_ijreq, buf_ijreq.count());
+		busy = true;
+	}
+
+	/* Pull inject stream and write to the clients, as long as the TX FIFOs take it */
+	do {
+		busy |= ijres_route();
+		more = false;
+		for (c = CLIENT_MIDI; c <= CLIENT_RAW; c++) {
+			t = &usb_tx[c];
+			if (t->pos == t->len)
+				continue;
+			if (c == CLIENT_RAW)
+				len = hal_raw_write(t->buf + t->pos, t->len - t->pos);
+			else
+				len = hal_midi_write(t->buf + t->pos, t->len - t->pos);
+			t->pos += len;
+			busy |= len > 0;
+			if (t->pos == t->len)
+				more = true;
+		}
+	} while (more);
+
+	net_tx_task();
+
+	if (do_trace && err_get() != trace_err) {
+		trace_err = err_get();
+		d[0] = trace_err;
+		d[1] = trace_err >> 8;
+		trace_put(&trace, TRACE_ERR, hal_time_us(), d, sizeof(d));
+	}
+
+	busy |= trace_drain() || do_record;
+
+	/* Core1 sees the queues changed, an idle pass sleeps until an interrupt or core1.
+	 * Single core: both have to be idle, the bus wakes too.
+	 */
+	if (busy) {
+		hal_notify();
+#if WAIT_EN
+	} else if (MC_EN || core1_idle) {
+		now = hal_time_us();
+		hal_wait(now + WAIT_MAX_US, !MC_EN);
+		stats.idle[0] += hal_time_us() - now;
+#endif
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef _BRIDGE_H_
+#define _BRIDGE_H_
+
+#include <cstdint>
+
+#include "sysex.h"
+#include "capture.h"
+#include "sysexq.h"
+
+#define BUF_ARENA 1             // Variable length frames in byte arenas instead of fixed slots
+
+#define BUFS_IC 8    // Interception buffer count (power of two), half of them may be loaned to ijres
+#define BUFS_IJREQ 16 // Inject request buffer count (power of two)
+#define BUFS_IJRES 8 // Inject response buffer count (power of two)
+
+#define ARENA_IC 2048           // Interception arena size (bytes, each stream)
+#define ARENA_IJREQ 4096        // Inject request arena size (bytes)
+#define ARENA_IJRES 2048        // Inject response arena size (bytes)
+#define IJRES_RESERVE 4         // 1/IJRES_RESERVE of buf_ijres is kept for the responses
+
+#define IJ_BURST 8              // Max back-to-back injected requests while DSPB is idle
+#define READY_IDLE_US 200000    // nIRQ1 idle before the readiness probe
+#define READY_PROBE_US 500000   // Between readiness probes
+#define READY_MAX_US 8000000    // Injection enabled at the latest
+#define REC_CHUNK_MAX 256       // Max captured bytes (each stream) in one raw record
+#define USB_TX_LEN 192          // USB-MIDI write gathered from ijres frames (4 full packets)
+#define WAIT_EN 1               // Idle cores sleep until notified (WFE) instead of polling the queues
+#define WAIT_MAX_US 1000        // Longest sleep: console UART and network timers are polled
+#if BUF_ARENA
+#define RAW_FRAME_MAX 512       // Max SysEx frame on the vendor interface
+#else
+#define RAW_FRAME_MAX BUF_LEN
+#endif
+#define RAW_HDR 4               // Vendor interface frame header: LE16 length, LE16 FRAME_TAG
+
+#define BR_DEBUG 1
+#ifndef MC_EN
+#define MC_EN 1                 // Enable multicore
+#endif
+
+#define PRINTBUF_MAX 64         // Maximum length of printed buffer (crop)
+#define PRINTBUF_BPL 64         // Bytes per line
+
+/* What enabled the injection */
+#define READY_NONE 0
+#define READY_NATIVE 1          // DSPB request answered by the CPB
+#define READY_PROBE 2           // injected status request answered
+#define READY_TIMEOUT 3
+
+#define ERR_NO_F0               (1 << 0)
+#define ERR_NO_F7               (1 << 1)
+#define ERR_RESP_TIMEOUT        (1 << 2)
+#define ERR_NULL_STATUS         (1 << 3)
+#define ERR_BUF_OVERFLOW        (1 << 4)
+#define ERR_IC_BUF_NOTREADY     (1 << 5)
+#define ERR_IJRES_BUF_NOTREADY  (1 << 6)
+#define ERR_CAP_OVERRUN         (1 << 7)
+
+#if BUF_ARENA
+typedef sysex_arena<ARENA_IC> ic_queue;
+typedef sysex_arena<ARENA_IJREQ> ijreq_queue;
+typedef sysex_arena<ARENA_IJRES> ijres_queue;
+#else
+typedef sysex_ring<BUFS_IC> ic_queue;
+typedef sysex_ring<BUFS_IJREQ> ijreq_queue;
+typedef sysex_ring<BUFS_IJRES> ijres_queue;
+#endif
+
+extern ic_queue buf_ic0;
+extern ic_queue buf_ic1;
+extern ijreq_queue buf_ijreq;
+extern ijres_queue buf_ijres;
+
+extern struct cap_ring cap[2];
+
+extern bool do_echo_fw;
+extern bool do_echo_usb;
+extern volatile uint8_t rules_presets;
+extern volatile uint8_t ic_route;
+extern bool do_cache;
+
+extern volatile uint16_t r_err[2];
+extern volatile uint8_t ready_by;
+extern uint32_t ready_us;
+
+struct bridge_stats;
+extern struct bridge_stats stats;
+
+const char *ready_name(uint8_t by);
+uint16_t err_get();
+void bridge_init();
+void bridge_task();
+void core1_main();
+
+#endif
@@ -0,0 +1,100 @@
+#include <cstring>
+
+#include "hal.h"
+#include "cache.h"
+
+void cache_init(struct resp_cache *c)
+{
+	cache_invalidate(c);
+	c->hits = 0;
+	c->misses = 0;
+}
+
+void HAL_RAM_FUNC(cache_invalidate)(struct resp_cache *c)
+{
+	uint8_t i;
+
+	for (i = 0; i < CACHE_ENTRIES; i++)
+		c->e[i].key_len = 0;
+}
+
+static struct cache_entry *HAL_RAM_FUNC(cache_find)(struct resp_cache *c, const struct sysex_buffer *req)
+{
+	uint8_t i;
+	struct cache_entry *e;
+
+	for (i = 0; i < CACHE_ENTRIES; i++) {
+		e = &c->e[i];
+		if (e->key_len == req->len && memcmp(e->key, req->buf, req->len) == 0)
+			return e;
+	}
+	return nullptr;
+}
+
+bool HAL_RAM_FUNC(cache_is_write)(const struct sysex_buffer *req)
+{
+	return req->len == 6 && req->buf[1] == CACHE_WRITE;
+}
+
+/* Write seen: the reads and the old value of the parameter are stale */
+static void HAL_RAM_FUNC(cache_write)(struct resp_cache *c, const struct sysex_buffer *req)
+{
+	uint8_t i;
+	struct cache_entry *e;
+
+	for (i = 0; i < CACHE_ENTRIES; i++) {
+		e = &c->e[i];
+		if (e->key_len && (e->key[1] != CACHE_WRITE || memcmp(e->key, req->buf, req->len - 2) == 0))
+			e->key_len = 0;
+	}
+}
+
+/* Completed transaction: refresh the entry, a write refreshes its parameter,
+ * any other request drops everything
+ */
+void HAL_RAM_FUNC(cache_update)(struct resp_cache *c, const struct sysex_buffer *req, const struct sysex_buffer *res,
+		bool cacheable, uint64_t now)
+{
+	uint8_t i;
+	struct cache_entry *e;
+
+	if (cache_is_write(req)) {
+		cache_write(c, req);
+	} else if (!cacheable || req->len > CACHE_KEY_MAX) {
+		cache_invalidate(c);
+		return;
+	}
+	if (res->len <= 0 || res->len > CACHE_RES_MAX)
+		return;
+
+	e = cache_find(c, req);
+	if (!e) {
+		/* Free or the oldest entry */
+		e = &c->e[0];
+		for (i = 0; i < CACHE_ENTRIES && e->key_len; i++) {
+			if (!c->e[i].key_len || c->e[i].ts < e->ts)
+				e = &c->e[i];
+		}
+		memcpy(e->key, req->buf, req->len);
+		e->key_len = req->len;
+	}
+	memcpy(e->res, res->buf, res->len);
+	e->res_len = res->len;
+	e->ts = now;
+}
+
+const struct cache_entry *HAL_RAM_FUNC(cache_get)(struct resp_cache *c, const struct sysex_buffer *req, uint64_t now)
+{
+	struct cache_entry *e;
+
+	if (req->len > CACHE_KEY_MAX)
+		return nullptr;
+
+	e = cache_find(c, req);
+	if (!e || now - e->ts > CACHE_MAX_AGE_US) {
+		c->misses++;
+		return nullptr;
+	}
+	c->hits++;
+	return e;
+}
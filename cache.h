@@ -0,0 +1,49 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <cstdint>
+
+#include "sysex.h"
+
+/* Shadow copy of the CPB responses, keyed by the whole request.
+ *
+ * Filled from the intercepted and the injected transactions. Requests
+ * classified as cacheable by the caller (rules.h) are kept, any other
+ * request may change the mixer state and drops the whole cache.
+ *
+ * Parameter writes (F0 10 <ch> <param> <value> F7) are the exception:
+ * a write replaces the entry of its parameter, so the cache holds the last
+ * value seen of each, and drops the cached reads (the status layout is not
+ * known), but not the other parameters. A write of the value already set
+ * is answered from its entry.
+ * Entries older than CACHE_MAX_AGE_US are not used.
+ */
+
+#define CACHE_ENTRIES 8
+#define CACHE_KEY_MAX 16                // longest cacheable request
+#define CACHE_RES_MAX BUF_LEN           // longest cacheable response
+#define CACHE_MAX_AGE_US 250000
+#define CACHE_WRITE 0x10                // parameter write command
+
+struct cache_entry {
+	uint8_t key[CACHE_KEY_MAX];
+	uint8_t key_len;                // 0: unused entry
+	int16_t res_len;
+	uint64_t ts;
+	uint8_t res[CACHE_RES_MAX];
+};
+
+struct resp_cache {
+	struct cache_entry e[CACHE_ENTRIES];
+	uint32_t hits;
+	uint32_t misses;
+};
+
+void cache_init(struct resp_cache *c);
+void cache_invalidate(struct resp_cache *c);
+bool cache_is_write(const struct sysex_buffer *req);
+void cache_update(struct resp_cache *c, const struct sysex_buffer *req, const struct sysex_buffer *res,
+		bool cacheable, uint64_t now);
+const struct cache_entry *cache_get(struct resp_cache *c, const struct sysex_buffer *req, uint64_t now);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <cstdint>
+
+/* Circular byte ring filled by a producer which only reports a free running
+ * count of written bytes (DMA transfer counter on the Pico).
+ * The buffer has to be aligned to CAP_RING_LEN for the DMA ring wrap.
+ */
+
+#define CAP_RING_BITS 10
+#define CAP_RING_LEN (1u << CAP_RING_BITS)
+#define CAP_RING_MASK (CAP_RING_LEN - 1)
+
+struct cap_ring {
+	uint8_t *buf;
+	uint32_t wr;        // free running write counter (last sample)
+	uint32_t rd;        // free running read counter
+	uint32_t lost;      // bytes overwritten by the producer before read
+};
+
+static inline void cap_init(struct cap_ring *r, uint8_t *buf)
+{
+	r->buf = buf;
+	r->wr = 0;
+	r->rd = 0;
+	r->lost = 0;
+}
+
+/* Update the write counter and return count of bytes ready for read.
+ * When the producer laps the reader, the oldest data are skipped.
+ */
+static inline uint32_t cap_update(struct cap_ring *r, uint32_t wr)
+{
+	uint32_t avail;
+
+	r->wr = wr;
+	avail = wr - r->rd;
+	if (avail > CAP_RING_LEN) {
+		r->lost += avail - CAP_RING_LEN;
+		r->rd = wr - CAP_RING_LEN;
+		avail = CAP_RING_LEN;
+	}
+	return avail;
+}
+
+static inline uint32_t cap_avail(struct cap_ring *r)
+{
+	return r->wr - r->rd;
+}
+
+/* Contiguous readable chunk, at most len bytes */
+static inline const uint8_t *cap_peek(struct cap_ring *r, uint32_t *len)
+{
+	uint32_t off = r->rd & CAP_RING_MASK;
+	uint32_t n = r->wr - r->rd;
+
+	if (n > CAP_RING_LEN - off)
+		n = CAP_RING_LEN - off;
+	if (n < *len)
+		*len = n;
+	return r->buf + off;
+}
+
+static inline void cap_consume(struct cap_ring *r, uint32_t len)
+{
+	r->rd += len;
+}
+
+static inline uint8_t cap_getc(struct cap_ring *r)
+{
+	return r->buf[r->rd++ & CAP_RING_MASK];
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#include <cstdint>
+
+/* Thin hardware abstraction of the bridge core.
+ * Implemented by hal_pico.cpp on the RPi Pico and by host/hal_sim.cpp
+ * against the simulated SPI bus.
+ */
+
+#define HAL_SPI_CPB     0       // SPI0: CPB MOSI in, MISO0 out
+#define HAL_SPI_DSPB    1       // SPI1: DSPB MISO in, MOSI1 out
+
+/* Mux select signals, see the README */
+#define HAL_MUX_NIRQ0   (1 << 0)
+#define HAL_MUX_MOSI1   (1 << 1)
+#define HAL_MUX_MISO0   (1 << 2)
+#define HAL_MUX_NSS1    (1 << 3)
+
+/* Deterministic latency profile (cmake -DRT=1): the capture and injection
+ * hot path runs from RAM instead of the XIP flash, the capture rings are in
+ * the scratch X bank next to the core1 stack, away from the core0 traffic.
+ * The core1 loop iteration time is collected in the statistics.
+ */
+#ifndef RT_EN
+#define RT_EN 0
+#endif
+#if RT_EN && PICO_ON_DEVICE
+#include "pico/platform.h"
+#define HAL_RAM_FUNC(f) __time_critical_func(f)
+#define HAL_SCRATCH_X __scratch_x("cap")
+#else
+#define HAL_RAM_FUNC(f) f
+#define HAL_SCRATCH_X
+#endif
+
+int hal_init();
+
+/* Capture ring of the SPI RX stream: buffer of CAP_RING_LEN bytes and
+ * a free running count of bytes written into it.
+ */
+uint8_t *hal_cap_buf(uint8_t spi);
+uint32_t hal_cap_wr(uint8_t spi);
+
+bool hal_spi_writable(uint8_t spi);
+void hal_spi_write(uint8_t spi, uint8_t c);
+
+void hal_mux_sel(uint8_t mux, bool inject);
+bool hal_irq1_get();            // nIRQ1 from DSPB
+void hal_irqb_put(bool v);      // nIRQ to CPB (injected nIRQ0)
+
+uint64_t hal_time_us();
+void hal_barrier();
+
+/* Inter-core doorbell: hal_notify wakes the other core from hal_wait.
+ * hal_wait sleeps until a doorbell, an interrupt or the time (us), it may
+ * return early. With bus, the bus edges (nSS of both SPI slaves, nIRQ1)
+ * wake the core too.
+ */
+void hal_notify();
+void hal_wait(uint64_t until, bool bus);
+
+void hal_task();
+int hal_getchar();
+
+uint32_t hal_midi_read(uint8_t *buf, uint32_t len);
+uint32_t hal_midi_write(const uint8_t *buf, uint32_t len);
+
+/* Vendor bulk interface: byte stream of length-prefixed raw SysEx frames */
+uint32_t hal_raw_read(uint8_t *buf, uint32_t len);
+uint32_t hal_raw_write(const uint8_t *buf, uint32_t len);
+
+/* UDP datagrams: received from any peer, sent to the peer of the last
+ * received one. Send returns false when the datagram is to be retried.
+ */
+uint32_t hal_net_recv(uint8_t *buf, uint32_t size);
+bool hal_net_send(const uint8_t *buf, uint32_t len);
+
+/* Binary trace stream to the host, returns count of accepted bytes */
+uint32_t hal_trace_write(const uint8_t *buf, uint32_t len);
+
+#endif
@@ -0,0 +1,479 @@
+#include <stdio.h>
+#include <cstdint>
+#include <cstring>
+
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/irq.h"
+#include "pico/binary_info.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+
+#include "mux.pio.h"
+#include "muxnss.pio.h"
+#include "spisniff.pio.h"
+
+#include "tusb.h"
+
+#if NET_EN
+#include "pico/cyw43_arch.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#endif
+
+#include "hal.h"
+#include "capture.h"
+#include "net.h"
+
+
+#define P_IRQ1  12 // Input from DSPB
+#define P_IRQB  13 // Output to CPB
+
+#define P_NSS1_DSPB     19 // Injected nSS1
+
+#define P_MUX_SEL_NIRQ0 20
+#define P_MUX_SEL_MOSI1 21
+#define P_MUX_SEL_MISO0 22
+#define P_MUX_SEL_NSS1  26
+
+#define CAP_DMA_EN 1            // Capture SPI RX FIFOs by DMA into circular rings
+#ifndef CAP_PIO_EN
+#define CAP_PIO_EN 0            // Capture by the spisniff PIO program instead of the SPI RX (needs CAP_DMA_EN)
+#endif
+#define P_CAP0  4               // Data pins of the SPI slaves: nSS and SCK follow
+#define P_CAP1  8
+#if CAP_PIO_EN && !CAP_DMA_EN
+#error "CAP_PIO_EN needs CAP_DMA_EN"
+#endif
+
+#define CAP_DMA_COUNT 0xFFFFFFFFu
+
+#define NET_RX_SLOTS 4          // Received datagrams not yet read by the bridge
+
+#if NET_EN
+static void net_init();
+#endif
+
+
+uint8_t HAL_SCRATCH_X cap_buf0[CAP_RING_LEN] __attribute__((aligned(CAP_RING_LEN)));
+uint8_t HAL_SCRATCH_X cap_buf1[CAP_RING_LEN] __attribute__((aligned(CAP_RING_LEN)));
+
+#if RT_EN
+/* Scratch X (4 KB) holds both rings and the stack of multicore_launch_core1 */
+static_assert(2 * CAP_RING_LEN + PICO_CORE1_STACK_SIZE <= 4096,
+		"capture rings and the core1 stack overflow scratch X");
+#endif
+
+#if CAP_DMA_EN
+uint32_t cap_dma_base[2];
+int cap_dma_ch[2];
+#if CAP_PIO_EN
+uint cap_sm[2];
+#endif
+#else
+uint32_t cap_wr[2];
+#endif
+
+
+int hal_init()
+{
+	uint8_t i;
+	uint8_t offset;
+	uint8_t pin;
+
+	PIO mypio;
+
+	set_sys_clock_khz(200000, false);
+
+	stdio_init_all();
+	stdio_set_translate_crlf(&stdio_usb, false);
+
+	for (i = 0; i < 4; i++) {
+		/* MUXed outputs */
+		gpio_init(i);
+		gpio_set_dir(i, 1);
+
+		/* Select pins */
+		pin = (i == 3 ? 26 : (i + 20));
+		gpio_init(pin);
+		gpio_set_dir(pin, 1);
+		gpio_put(pin, 0);
+	}
+
+	gpio_init(P_IRQ1);
+	gpio_init(P_IRQB);
+	gpio_init(P_NSS1_DSPB);
+	gpio_set_dir(P_IRQ1, 0);
+	gpio_set_dir(P_IRQB, 1);
+	gpio_set_dir(P_NSS1_DSPB, 1);
+	gpio_put(P_IRQB, 1);
+	gpio_put(P_NSS1_DSPB, 1);
+
+	mypio = pio_get_instance(0);
+	for (i = 12; i < 20; i++) {
+		hw_set_bits(&mypio->input_sync_bypass, (1u << i));
+	}
+
+	offset = pio_add_program(pio0, &mux_program);
+	for (i = 0; i < 4; i++) {
+		if (i == 2)
+			continue;
+		pio_gpio_init(pio0, i);
+
+		pio_sm_config c = mux_program_get_default_config(offset);
+		sm_config_set_in_pins(&c, 12 + i * 2);
+		sm_config_set_out_pins(&c, i, 1);
+		sm_config_set_jmp_pin(&c, i == 3 ? 26 : (20 + i));
+		sm_config_set_out_shift(&c, false, false, 1);
+		pio_sm_set_consecutive_pindirs(pio0, i, i, 1, true);
+		pio_sm_init(pio0, i, offset, &c);
+	}
+
+	offset = pio_add_program(pio0, &muxnss_program);
+	i = 2; {
+		pio_gpio_init(pio0, i);
+
+		pio_sm_config c = muxnss_program_get_default_config(offset);
+		sm_config_set_in_pins(&c, 22);
+		sm_config_set_out_pins(&c, i, 1);
+		sm_config_set_jmp_pin(&c, 5);
+		sm_config_set_out_shift(&c, false, false, 1);
+		pio_sm_set_consecutive_pindirs(pio0, i, i, 1, true);
+		pio_sm_init(pio0, i, offset, &c);
+	}
+	pio_set_sm_mask_enabled(pio0, 0x0F, true);
+	pio_claim_sm_mask(pio0, 0x0F);          // the CYW43 driver takes a free PIO SM
+
+	spi_init(spi0, 2 * 1000000);
+	spi_init(spi1, 2 * 1000000);
+	spi_set_slave(spi0, true);
+	spi_set_slave(spi1, true);
+
+	for (i = 4; i < 12; i++) {
+		gpio_set_function(i, GPIO_FUNC_SPI);
+	}
+
+	bi_decl(bi_4pins_with_func(4, 5, 6, 7, GPIO_FUNC_SPI));
+	bi_decl(bi_4pins_with_func(8, 9, 10, 11, GPIO_FUNC_SPI));
+
+	//gpio_set_function(P_IRQ1, GPIO_FUNC_SIO);
+	//gpio_set_function(P_IRQB, GPIO_FUNC_SIO);
+
+#if CAP_PIO_EN
+	/* Both data lines sampled by pio1 (pio0 is full, the CYW43 driver
+	 * takes the next free SM), the SPIs only transmit the injection.
+	 * PIO reads the pins whatever function they have.
+	 */
+	offset = pio_add_program(pio1, &spisniff_program);
+	for (i = 0; i < 2; i++) {
+		pin = i ? P_CAP1 : P_CAP0;
+		cap_sm[i] = pio_claim_unused_sm(pio1, true);
+
+		pio_sm_config c = spisniff_program_get_default_config(offset);
+		sm_config_set_in_pins(&c, pin);
+		sm_config_set_jmp_pin(&c, pin + 1);
+		sm_config_set_in_shift(&c, false, true, 8);
+		sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+		pio_sm_init(pio1, cap_sm[i], offset + spisniff_offset_entry, &c);
+	}
+#endif
+
+#if CAP_DMA_EN
+	for (i = 0; i < 2; i++) {
+		cap_dma_base[i] = 0;
+		cap_dma_ch[i] = dma_claim_unused_channel(true);
+
+		dma_channel_config c = dma_channel_get_default_config(cap_dma_ch[i]);
+		channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+		channel_config_set_read_increment(&c, false);
+		channel_config_set_write_increment(&c, true);
+		channel_config_set_ring(&c, true, CAP_RING_BITS);
+#if CAP_PIO_EN
+		/* Shift left: the byte is in the low lane of the FIFO entry */
+		channel_config_set_dreq(&c, pio_get_dreq(pio1, cap_sm[i], false));
+		dma_channel_configure(cap_dma_ch[i], &c, i ? cap_buf1 : cap_buf0,
+				&pio1->rxf[cap_sm[i]], CAP_DMA_COUNT, false);
+#else
+		spi_inst_t *spi = i ? spi1 : spi0;
+
+		channel_config_set_dreq(&c, spi_get_dreq(spi, false));
+		dma_channel_configure(cap_dma_ch[i], &c, i ? cap_buf1 : cap_buf0,
+				&spi_get_hw(spi)->dr, CAP_DMA_COUNT, false);
+#endif
+	}
+	/* Both SPIs are clocked by the same SCK: start both channels at once */
+	dma_start_channel_mask((1u << cap_dma_ch[0]) | (1u << cap_dma_ch[1]));
+#if CAP_PIO_EN
+	pio_enable_sm_mask_in_sync(pio1, (1u << cap_sm[0]) | (1u << cap_sm[1]));
+#endif
+#endif
+
+#if NET_EN
+	net_init();
+#endif
+
+	return 0;
+}
+
+uint8_t *hal_cap_buf(uint8_t spi)
+{
+	return spi ? cap_buf1 : cap_buf0;
+}
+
+uint32_t HAL_RAM_FUNC(hal_cap_wr)(uint8_t spi)
+{
+#if CAP_DMA_EN
+	uint32_t n;
+
+	n = dma_hw->ch[cap_dma_ch[spi]].transfer_count;
+	if (n == 0 && !dma_channel_is_busy(cap_dma_ch[spi])) {
+		/* Transfer counter exhausted: rearm, the ring write address continues */
+		cap_dma_base[spi] += CAP_DMA_COUNT;
+		dma_channel_set_trans_count(cap_dma_ch[spi], CAP_DMA_COUNT, true);
+		n = CAP_DMA_COUNT;
+	}
+	return cap_dma_base[spi] + (CAP_DMA_COUNT - n);
+#else
+	spi_inst_t *s = spi ? spi1 : spi0;
+	uint8_t *buf = spi ? cap_buf1 : cap_buf0;
+
+	while (spi_is_readable(s))
+		buf[cap_wr[spi]++ & CAP_RING_MASK] = spi_get_hw(s)->dr;
+	return cap_wr[spi];
+#endif
+}
+
+bool HAL_RAM_FUNC(hal_spi_writable)(uint8_t spi)
+{
+	return spi_is_writable(spi ? spi1 : spi0);
+}
+
+void HAL_RAM_FUNC(hal_spi_write)(uint8_t spi, uint8_t c)
+{
+	spi_get_hw(spi ? spi1 : spi0)->dr = c;
+}
+
+void HAL_RAM_FUNC(hal_mux_sel)(uint8_t mux, bool inject)
+{
+	if (mux & HAL_MUX_NSS1)
+		gpio_put(P_MUX_SEL_NSS1, inject);
+	if (mux & HAL_MUX_MISO0)
+		gpio_put(P_MUX_SEL_MISO0, inject);
+	if (mux & HAL_MUX_MOSI1)
+		gpio_put(P_MUX_SEL_MOSI1, inject);
+	if (mux & HAL_MUX_NIRQ0)
+		gpio_put(P_MUX_SEL_NIRQ0, inject);
+}
+
+bool HAL_RAM_FUNC(hal_irq1_get)()
+{
+	return gpio_get(P_IRQ1);
+}
+
+void HAL_RAM_FUNC(hal_irqb_put)(bool v)
+{
+	gpio_put(P_IRQB, v);
+}
+
+uint64_t HAL_RAM_FUNC(hal_time_us)()
+{
+	return time_us_64();
+}
+
+void hal_barrier()
+{
+	__dmb();
+}
+
+void hal_notify()
+{
+	__sev();
+}
+
+/* Bus edges waking the core: armed for the sleep, disarmed by the first one,
+ * so the traffic does not interrupt the capture. The edges latched since
+ * the last wake fire as soon as armed, none is lost.
+ */
+static const uint8_t bus_wake_pin[] = {P_CAP0 + 1, P_CAP1 + 1, P_IRQ1};
+static const uint32_t bus_wake_ev[] = {GPIO_IRQ_EDGE_FALL, GPIO_IRQ_EDGE_FALL,
+		GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE};
+static bool bus_wake_init[2];
+
+static void bus_wake_arm(bool en)
+{
+	io_irq_ctrl_hw_t *c = get_core_num() ? &iobank0_hw->proc1_irq_ctrl : &iobank0_hw->proc0_irq_ctrl;
+	uint8_t i, pin;
+
+	for (i = 0; i < sizeof(bus_wake_pin); i++) {
+		pin = bus_wake_pin[i];
+		if (en)
+			hw_set_bits(&c->inte[pin / 8], bus_wake_ev[i] << 4 * (pin % 8));
+		else
+			hw_clear_bits(&c->inte[pin / 8], bus_wake_ev[i] << 4 * (pin % 8));
+	}
+}
+
+/* The SDK handler acknowledges the edge, the core is awake by now */
+static void bus_edge(uint gpio, uint32_t events)
+{
+	bus_wake_arm(false);
+}
+
+void hal_wait(uint64_t until, bool bus)
+{
+	uint core = get_core_num();
+
+	if (bus && !bus_wake_init[core]) {
+		gpio_set_irq_callback(bus_edge);
+		irq_set_enabled(IO_IRQ_BANK0, true);
+		bus_wake_init[core] = true;
+	}
+	if (bus)
+		bus_wake_arm(true);
+	best_effort_wfe_or_timeout(from_us_since_boot(until));
+	if (bus)
+		bus_wake_arm(false);
+}
+
+void hal_task()
+{
+	tud_task();
+#if NET_EN
+	cyw43_arch_poll();
+#endif
+}
+
+int hal_getchar()
+{
+	return stdio_getchar_timeout_us(0);
+}
+
+uint32_t hal_midi_read(uint8_t *buf, uint32_t len)
+{
+	return tud_midi_n_stream_read(0, 0, buf, len);
+}
+
+/* Writes to an unmounted interface are dropped, other clients go on */
+uint32_t hal_midi_write(const uint8_t *buf, uint32_t len)
+{
+	if (!tud_midi_n_mounted(0))
+		return len;
+	return tud_midi_n_stream_write(0, 0, buf, len);
+}
+
+uint32_t hal_raw_read(uint8_t *buf, uint32_t len)
+{
+	return tud_vendor_n_read(0, buf, len);
+}
+
+uint32_t hal_raw_write(const uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+
+	if (!tud_vendor_n_mounted(0))
+		return len;
+	n = tud_vendor_n_write(0, buf, len);
+	tud_vendor_n_write_flush(0);
+	return n;
+}
+
+#if NET_EN
+/* lwIP runs from cyw43_arch_poll in hal_task, on core0 as the bridge reads */
+static struct udp_pcb *net_pcb;
+static ip_addr_t net_peer;
+static uint16_t net_peer_port;
+static bool net_peer_valid;
+static uint8_t net_rx_buf[NET_RX_SLOTS][NET_DGRAM_MAX];
+static uint16_t net_rx_len[NET_RX_SLOTS];
+static uint32_t net_rx_wr;
+static uint32_t net_rx_rd;
+
+static void net_recv_cb(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+	uint8_t slot;
+
+	/* Dropped when full: no response and no notice, net_seq_check sees the datagram seq gap */
+	if (net_rx_wr - net_rx_rd < NET_RX_SLOTS && p->tot_len <= NET_DGRAM_MAX) {
+		slot = net_rx_wr % NET_RX_SLOTS;
+		net_rx_len[slot] = pbuf_copy_partial(p, net_rx_buf[slot], p->tot_len, 0);
+		net_rx_wr++;
+		ip_addr_copy(net_peer, *addr);
+		net_peer_port = port;
+		net_peer_valid = true;
+	}
+	pbuf_free(p);
+}
+
+static void net_init()
+{
+	if (cyw43_arch_init())
+		return;
+	cyw43_arch_enable_sta_mode();
+	cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK);
+
+	net_pcb = udp_new();
+	if (net_pcb) {
+		udp_bind(net_pcb, IP_ANY_TYPE, NET_PORT);
+		udp_recv(net_pcb, net_recv_cb, NULL);
+	}
+}
+
+uint32_t hal_net_recv(uint8_t *buf, uint32_t size)
+{
+	uint8_t slot;
+	uint32_t n;
+
+	if (net_rx_rd == net_rx_wr)
+		return 0;
+	slot = net_rx_rd % NET_RX_SLOTS;
+	n = net_rx_len[slot] < size ? net_rx_len[slot] : size;
+	memcpy(buf, net_rx_buf[slot], n);
+	net_rx_rd++;
+	return n;
+}
+
+bool hal_net_send(const uint8_t *buf, uint32_t len)
+{
+	struct pbuf *p;
+	err_t err;
+
+	if (!net_pcb || !net_peer_valid)
+		return true;
+	p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+	if (!p)
+		return false;
+	memcpy(p->payload, buf, len);
+	err = udp_sendto(net_pcb, p, &net_peer, net_peer_port);
+	pbuf_free(p);
+	return err != ERR_MEM;
+}
+#else
+uint32_t hal_net_recv(uint8_t *buf, uint32_t size)
+{
+	return 0;
+}
+
+bool hal_net_send(const uint8_t *buf, uint32_t len)
+{
+	return true;
+}
+#endif
+
+/* Trace goes to the CDC together with the console, without blocking */
+uint32_t hal_trace_write(const uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+
+	if (!tud_cdc_connected())
+		return len;
+
+	n = tud_cdc_write_available();
+	if (n > len)
+		n = len;
+	if (n) {
+		tud_cdc_write(buf, n);
+		tud_cdc_write_flush();
+	}
+	return n;
+}
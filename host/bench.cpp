@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bridge.h"
+#include "status.h"
+#include "bench_traffic.h"
+
+/* Cost of the bridge stages on the host, best of the rounds:
+ * append  per-byte framing (buf_append)
+ * chunk   block framing of DMA chunks (buf_append_chunk)
+ * queue   framing into the interception arena and the hand-off to the consumer
+ * status  status response classification, field update and delta encoding
+ * usb     USB-MIDI 1.0 event packing of the responses (model of the TinyUSB stream write)
+ */
+
+#define USB_EP_LEN 64
+
+struct stage {
+	const char *name;
+	uint64_t bytes;
+	uint64_t msgs;
+	double ns;
+};
+
+typedef std::vector<std::vector<uint8_t> > frames;
+
+static std::vector<uint8_t> traffic;
+static std::vector<uint16_t> chunks;
+static frames msgs;
+static frames status_res;
+static volatile uint64_t sink;          // results, which must not be optimized out
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void run_append(struct stage *st)
+{
+	uint8_t data[BUF_LEN];
+	struct sysex_buffer s = {data, BUF_LEN};
+	size_t i;
+
+	buf_clear(&s);
+	auto t0 = std::chrono::steady_clock::now();
+	for (i = 0; i < traffic.size(); i++) {
+		buf_append(&s, traffic[i]);
+		if (buf_full(&s) || s.pos == s.size) {
+			st->msgs++;
+			buf_clear(&s);
+		}
+	}
+	st->ns = elapsed(t0);
+	st->bytes = traffic.size();
+}
+
+static void run_chunk(struct stage *st)
+{
+	uint8_t data[BUF_LEN];
+	struct sysex_buffer s = {data, BUF_LEN};
+	size_t off = 0;
+	size_t k = 0;
+	uint16_t len, n;
+
+	buf_clear(&s);
+	auto t0 = std::chrono::steady_clock::now();
+	while (off < traffic.size()) {
+		len = chunks[k++ % chunks.size()];
+		if (len > traffic.size() - off)
+			len = traffic.size() - off;
+		while (len) {
+			n = buf_append_chunk(&s, &traffic[off], len);
+			off += n;
+			len -= n;
+			if (buf_full(&s) || s.pos == s.size) {
+				st->msgs++;
+				buf_clear(&s);
+			}
+		}
+	}
+	st->ns = elapsed(t0);
+	st->bytes = traffic.size();
+}
+
+static ic_queue q;
+static bool threaded;                   // consumer on a second thread, needs two CPUs
+
+static uint64_t drain()
+{
+	uint64_t n = 0;
+
+	while (q.front()) {
+		q.release();
+		n++;
+	}
+	return n;
+}
+
+static void run_queue(struct stage *st)
+{
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> consumed(0);
+	struct sysex_buffer *s = nullptr;
+	size_t off = 0;
+	size_t k = 0;
+	uint16_t len, n;
+	std::thread consumer;
+
+	auto t0 = std::chrono::steady_clock::now();
+	if (threaded) {
+		consumer = std::thread([&] {
+			while (!done.load(std::memory_order_acquire))
+				consumed += drain();
+			consumed += drain();
+		});
+	}
+
+	while (off < traffic.size()) {
+		len = chunks[k++ % chunks.size()];
+		if (len > traffic.size() - off)
+			len = traffic.size() - off;
+		while (len) {
+			while (!s) {
+				s = q.claim();
+				if (!s && !threaded)
+					consumed += drain();
+			}
+			n = queue_append_chunk(q, s, &traffic[off], len);
+			off += n;
+			len -= n;
+			if (buf_full(s)) {
+				q.commit();
+				q.publish();
+				s = nullptr;
+			} else if (s->pos == s->size) {
+				if (!threaded) {
+					consumed += drain();
+					s = q.grow(s);
+				}
+				/* No space to grow the frame, drop it as core1 does */
+				if (s->pos == s->size)
+					buf_clear(s);
+			}
+		}
+	}
+	if (threaded) {
+		done.store(true, std::memory_order_release);
+		consumer.join();
+	} else {
+		consumed += drain();
+	}
+	st->ns = elapsed(t0);
+	st->bytes = traffic.size();
+	st->msgs = consumed;
+}
+
+static void run_status(struct stage *st)
+{
+	struct status_model m;
+	struct sysex_buffer s;
+	uint8_t delta[STATUS_DELTA_MAX];
+	uint64_t changed;
+	size_t i;
+
+	status_init(&m);
+	m.sub[CLIENT_MIDI] = ~0ull;
+	auto t0 = std::chrono::steady_clock::now();
+	for (i = 0; i < status_res.size(); i++) {
+		s.buf = status_res[i].data();
+		s.len = s.pos = status_res[i].size();
+		s.invalid_pre = s.invalid_post = 0;
+		if (is_status_req(&s) || !is_status_res(&s))
+			continue;
+		changed = status_client_mask(&m, CLIENT_MIDI, status_update(&m, &s));
+		if (changed && status_delta(&m, changed, delta, sizeof(delta)) > 0)
+			st->msgs++;
+		st->bytes += s.len;
+	}
+	st->ns = elapsed(t0);
+}
+
+/* SysEx to USB-MIDI event packets: CIN 4 for three bytes with more to come,
+ * CIN 5, 6, 7 for the last one, two or three bytes.
+ */
+static void run_usb(struct stage *st)
+{
+	uint8_t ep[USB_EP_LEN];
+	uint32_t pos = 0;
+	uint64_t packets = 0;
+	size_t i;
+	uint16_t j, n;
+	const uint8_t *p;
+
+	auto t0 = std::chrono::steady_clock::now();
+	for (i = 0; i < msgs.size(); i++) {
+		p = msgs[i].data();
+		for (j = 0; j < msgs[i].size(); j += n) {
+			n = msgs[i].size() - j;
+			if (n > 3)
+				n = 3;
+			ep[pos] = (j + n == msgs[i].size()) ? 0x4 + n : 0x4;
+			ep[pos + 1] = p[j];
+			ep[pos + 2] = n > 1 ? p[j + 1] : 0;
+			ep[pos + 3] = n > 2 ? p[j + 2] : 0;
+			pos += 4;
+			if (pos == USB_EP_LEN) {
+				packets++;
+				pos = 0;
+			}
+		}
+		st->bytes += msgs[i].size();
+	}
+	st->ns = elapsed(t0);
+	st->msgs = msgs.size();
+	sink = packets + ep[0];
+}
+
+/* Frames of the traffic, for the stages after the framer */
+static void split_frames()
+{
+	uint8_t data[BUF_LEN];
+	struct sysex_buffer s = {data, BUF_LEN};
+	size_t i;
+
+	buf_clear(&s);
+	for (i = 0; i < traffic.size(); i++) {
+		buf_append(&s, traffic[i]);
+		if (buf_full(&s)) {
+			msgs.push_back(std::vector<uint8_t>(data, data + s.len));
+			buf_clear(&s);
+		} else if (s.pos == s.size) {
+			buf_clear(&s);
+		}
+	}
+}
+
+/* Status responses, a few fields change between two polls */
+static void gen_status(std::mt19937 &rng)
+{
+	std::vector<uint8_t> v;
+	size_t bytes = 0;
+	int i, n;
+
+	put_msg(v, rng, 0x39, BUF_STATUS_LEN);
+	v[2] = 0x03;
+	while (bytes < BENCH_BYTES) {
+		n = rng() % 4;
+		for (i = 0; i < n; i++)
+			v[STATUS_HDR + rng() % STATUS_FIELDS] = rng() & 0x7F;
+		status_res.push_back(v);
+		bytes += v.size();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	void (*fn[])(struct stage *) = {run_append, run_chunk, run_queue, run_status, run_usb};
+	const char *names[] = {"append", "chunk", "queue", "status", "usb"};
+	int rounds = argc > 1 ? atoi(argv[1]) : 5;
+	const char *mix = argc > 2 ? argv[2] : "mixed";
+	std::mt19937 rng(1);
+	struct stage st, best;
+	unsigned i;
+	int k;
+	int ret = 0;
+
+	threaded = std::thread::hardware_concurrency() > 1;
+	traffic = gen(mix, rng);
+	chunks = gen_chunks(rng);
+	split_frames();
+	gen_status(rng);
+
+	printf("Traffic mix %s, %lu bytes, %lu frames, queue consumer %s\n", mix,
+			(unsigned long)traffic.size(), (unsigned long)msgs.size(),
+			threaded ? "on a second thread" : "inline");
+	printf("%-8s %10s %10s %10s %12s\n", "stage", "bytes", "msgs", "ns/B", "msgs/s");
+	for (i = 0; i < sizeof(fn) / sizeof(fn[0]); i++) {
+		memset(&best, 0, sizeof(best));
+		best.ns = 1e30;
+		for (k = 0; k < rounds; k++) {
+			memset(&st, 0, sizeof(st));
+			fn[i](&st);
+			if (st.ns < best.ns)
+				best = st;
+		}
+		printf("%-8s %10lu %10lu %10.2f %12.0f\n", names[i],
+				(unsigned long)best.bytes, (unsigned long)best.msgs,
+				best.ns / best.bytes, best.msgs / (best.ns / 1e9));
+
+		/* A claimed frame holds SYSEX_ARENA_MIN bytes at least: frames up to that
+		 * never have to grow, none is dropped
+		 */
+		if (fn[i] == run_queue && best.msgs != msgs.size()) {
+			fprintf(stderr, "queue: %lu frames lost\n", (unsigned long)(msgs.size() - best.msgs));
+			ret = 1;
+		}
+	}
+	return ret;
+}
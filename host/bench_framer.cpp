@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "sysex.h"
+#include "bench_traffic.h"
+
+/* Block framer (buf_append_chunk) against the per-byte buf_append loop
+ * on captured-like traffic. Both have to produce the same frames.
+ */
+
+struct result {
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t invalid_pre;
+	uint64_t invalid_post;
+	uint32_t sum;
+	double ns;
+};
+
+/* Reference: the per-byte loop */
+static uint16_t ref_append_chunk(struct sysex_buffer *s, const uint8_t *data, uint16_t len)
+{
+	uint16_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf_append(s, data[i]) > 0)
+			return i + 1;
+		if (s->pos == s->size)
+			return i + 1;
+	}
+	return len;
+}
+
+template <class F>
+static struct result run(const std::vector<uint8_t> &v, const std::vector<uint16_t> &chunks, F fn)
+{
+	uint8_t data[BUF_LEN];
+	struct sysex_buffer s = {data, BUF_LEN};
+	struct result r = {};
+	size_t off = 0;
+	size_t k = 0;
+	uint16_t len, n;
+	int16_t j;
+
+	buf_clear(&s);
+	auto t0 = std::chrono::steady_clock::now();
+	while (off < v.size()) {
+		len = chunks[k++ % chunks.size()];
+		if (len > v.size() - off)
+			len = v.size() - off;
+		while (len) {
+			n = fn(&s, &v[off], len);
+			off += n;
+			len -= n;
+			if (buf_full(&s)) {
+				r.frames++;
+				r.bytes += s.len;
+				for (j = 0; j < s.len; j++)
+					r.sum = r.sum * 31 + data[j];
+				r.invalid_pre += s.invalid_pre;
+				r.invalid_post += s.invalid_post;
+				buf_clear(&s);
+			}
+		}
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	r.ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mixes[] = {"status", "writes", "idle", "long", "mixed"};
+	unsigned i;
+	int rounds = argc > 1 ? atoi(argv[1]) : 5;
+	int k;
+	bool ok = true;
+	std::mt19937 rng(1);
+	std::vector<uint16_t> chunks = gen_chunks(rng);
+	struct result a, b, ra, rb;
+
+	printf("%-8s %10s %12s %12s %8s\n", "mix", "frames", "per-byte", "block", "speedup");
+	for (i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++) {
+		std::vector<uint8_t> v = gen(mixes[i], rng);
+
+		ra.ns = rb.ns = 1e30;
+		for (k = 0; k < rounds; k++) {
+			a = run(v, chunks, ref_append_chunk);
+			b = run(v, chunks, buf_append_chunk);
+			if (a.ns < ra.ns)
+				ra = a;
+			if (b.ns < rb.ns)
+				rb = b;
+		}
+
+		if (a.frames != b.frames || a.bytes != b.bytes || a.sum != b.sum ||
+				a.invalid_pre != b.invalid_pre || a.invalid_post != b.invalid_post) {
+			printf("%-8s MISMATCH frames %lu/%lu pre %lu/%lu post %lu/%lu\n", mixes[i],
+					(unsigned long)a.frames, (unsigned long)b.frames,
+					(unsigned long)a.invalid_pre, (unsigned long)b.invalid_pre,
+					(unsigned long)a.invalid_post, (unsigned long)b.invalid_post);
+			ok = false;
+			continue;
+		}
+		printf("%-8s %10lu %9.2f ns/B %9.2f ns/B %7.2fx\n", mixes[i], (unsigned long)a.frames,
+				ra.ns / v.size(), rb.ns / v.size(), ra.ns / rb.ns);
+	}
+	return ok ? 0 : 1;
+}
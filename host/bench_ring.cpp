@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "ring.h"
+
+/* Throughput of spsc_ring between two threads, per ring depth and
+ * number of slots published at once. Best of the rounds.
+ */
+
+#define BENCH_ITEMS 20000000u
+
+template <unsigned N>
+static double run(uint32_t items, uint32_t batch)
+{
+	static spsc_ring<uint32_t, N> q;
+	volatile uint32_t sink = 0;
+	uint32_t seq = 0;
+	uint32_t k = 0;
+	uint32_t *s;
+
+	auto t0 = std::chrono::steady_clock::now();
+	std::thread consumer([&] {
+		uint32_t n = 0;
+		uint32_t *c;
+
+		while (n < items) {
+			c = q.front();
+			if (!c) {
+				std::this_thread::yield();
+				continue;
+			}
+			sink = *c;
+			q.release();
+			n++;
+		}
+	});
+
+	while (seq < items) {
+		s = q.claim();
+		if (!s) {
+			q.publish();
+			std::this_thread::yield();
+			continue;
+		}
+		*s = seq++;
+		q.commit();
+		if (++k == batch || seq == items) {
+			q.publish();
+			k = 0;
+		}
+	}
+	consumer.join();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+template <unsigned N>
+static void row(uint32_t items, int rounds)
+{
+	static const uint32_t batches[] = {1, 4, N / 2};
+	double t, best;
+	unsigned i;
+	int k;
+
+	printf("%5u", N);
+	for (i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+		best = 1e30;
+		for (k = 0; k < rounds; k++) {
+			t = run<N>(items, batches[i]);
+			if (t < best)
+				best = t;
+		}
+		printf(" %12.2f", items / best / 1e6);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 3;
+	uint32_t items = argc > 2 ? strtoul(argv[2], nullptr, 0) : BENCH_ITEMS;
+
+	if (std::thread::hardware_concurrency() < 2)
+		printf("Single CPU: the threads take turns, the numbers are not meaningful\n");
+	printf("Mslots/s, %u items, publish after 1, 4, N/2 slots\n", items);
+	printf("%5s %12s %12s %12s\n", "N", "batch 1", "batch 4", "batch N/2");
+	row<8>(items, rounds);
+	row<16>(items, rounds);
+	row<64>(items, rounds);
+	return 0;
+}
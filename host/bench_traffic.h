@@ -0,0 +1,73 @@
+#ifndef _BENCH_TRAFFIC_H_
+#define _BENCH_TRAFFIC_H_
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "sysex.h"
+
+/* Captured-like bus traffic for the host benchmarks */
+
+#define BENCH_BYTES (4 << 20)
+
+static inline void put_msg(std::vector<uint8_t> &v, std::mt19937 &rng, uint8_t cmd, int len)
+{
+	int i;
+
+	v.push_back(0xF0);
+	v.push_back(cmd);
+	for (i = 2; i < len - 1; i++)
+		v.push_back(rng() & 0x7F);
+	v.push_back(0xF7);
+}
+
+/* Bus capture: requests with idle bytes while the master waits, responses */
+static inline std::vector<uint8_t> gen(const char *mix, std::mt19937 &rng)
+{
+	std::vector<uint8_t> v;
+	int r;
+
+	while (v.size() < BENCH_BYTES) {
+		r = rng() % 100;
+		if (!strcmp(mix, "status")) {
+			v.insert(v.end(), {0xF0, 0x38, 0x03, 0xF7});
+			v.insert(v.end(), 8, 0x00);
+			put_msg(v, rng, 0x39, BUF_STATUS_LEN);
+		} else if (!strcmp(mix, "writes")) {
+			put_msg(v, rng, 0x10, 6);
+			v.insert(v.end(), 8, 0x00);
+			put_msg(v, rng, 0x11, 5);
+		} else if (!strcmp(mix, "idle")) {
+			v.insert(v.end(), 200, 0x00);
+			put_msg(v, rng, 0x10, 6);
+		} else if (!strcmp(mix, "long")) {
+			put_msg(v, rng, 0x20, BUF_LEN);
+		} else {
+			/* mixed, with some noise bytes */
+			if (r < 40)
+				put_msg(v, rng, 0x39, BUF_STATUS_LEN);
+			else if (r < 80)
+				put_msg(v, rng, 0x10, 6);
+			else if (r < 90)
+				put_msg(v, rng, 0x20, 100);
+			else
+				v.insert(v.end(), rng() % 64, rng());
+		}
+	}
+	return v;
+}
+
+/* DMA chunk lengths as core1 sees them */
+static inline std::vector<uint16_t> gen_chunks(std::mt19937 &rng)
+{
+	std::vector<uint16_t> chunks;
+	int i;
+
+	for (i = 0; i < 1024; i++)
+		chunks.push_back(1 + rng() % 64);
+	return chunks;
+}
+
+#endif
@@ -0,0 +1,274 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "hal.h"
+#include "bridge.h"
+#include "trace.h"
+#include "replay.h"
+
+/* HAL fed from a recorded trace stream (console command r on the device).
+ * TRACE_RAW records go into the capture rings as soon as the bridge has
+ * consumed enough of them, or at their recorded time in the real time mode.
+ * TRACE_PIN records set nIRQ1 and the recorded nIRQB and mux selects:
+ * while the bridge drove NSS1 or nIRQB, the captured bytes are its own injected
+ * transaction and are counted, not fed as intercepted DSPB traffic.
+ * There is no USB host and the replayed bridge does not inject.
+ */
+
+static struct {
+	FILE *f;
+	FILE *trace_out;
+	const char *cmds;
+	bool realtime;
+	bool eof;
+
+	uint8_t hdr[TRACE_HDR];
+	uint8_t data[0x10000];
+	uint16_t len;
+	bool pending;
+
+	uint64_t now;                   // us, recorded time of the last fed record
+	uint32_t ts_last;
+	std::chrono::steady_clock::time_point t0;
+
+	alignas(CAP_RING_LEN) uint8_t ring[2][CAP_RING_LEN];
+	uint32_t wr;
+	bool irq1;
+	bool irqb;                      // recorded nIRQB
+	uint8_t mux;                    // recorded HAL_MUX_ selects
+
+	struct replay_stats st;
+} rp;
+
+void replay_open(FILE *f, bool realtime, const char *cmds, FILE *trace_out)
+{
+	rp.f = f;
+	rp.realtime = realtime;
+	rp.cmds = cmds;
+	rp.trace_out = trace_out;
+	rp.eof = false;
+	rp.pending = false;
+	rp.now = 0;
+	rp.wr = 0;
+	rp.irq1 = true;
+	rp.irqb = true;
+	rp.mux = 0;
+	memset(&rp.st, 0, sizeof(rp.st));
+}
+
+static bool load()
+{
+	int c;
+
+	while ((c = fgetc(rp.f)) != EOF) {
+		if (c != TRACE_MAGIC) {
+			rp.st.skipped++;
+			continue;
+		}
+		rp.hdr[0] = c;
+		if (fread(rp.hdr + 1, 1, TRACE_HDR - 1, rp.f) != TRACE_HDR - 1)
+			break;
+		rp.len = rp.hdr[2] | rp.hdr[3] << 8;
+		if (fread(rp.data, 1, rp.len, rp.f) != rp.len)
+			break;
+		return true;
+	}
+	rp.eof = true;
+	return false;
+}
+
+static uint64_t wall_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - rp.t0).count();
+}
+
+/* The recorded bridge owned the CPB bus: NSS1 driven or nIRQB asserted */
+static bool injecting()
+{
+	return (rp.mux & HAL_MUX_NSS1) || !rp.irqb;
+}
+
+/* Feed the records, which fit in the rings and are due */
+static void feed()
+{
+	uint32_t ts, rd, n, off, k;
+	bool inj;
+
+	while (!rp.eof) {
+		if (!rp.pending) {
+			if (!load())
+				return;
+			rp.pending = true;
+		}
+
+		/* Extend the 32-bit timestamps */
+		ts = rp.hdr[4] | rp.hdr[5] << 8 | rp.hdr[6] << 16 | (uint32_t)rp.hdr[7] << 24;
+		if (rp.st.records == 0) {
+			rp.now = ts;
+			rp.t0 = std::chrono::steady_clock::now() - std::chrono::microseconds(ts);
+		}
+		if (rp.realtime && wall_us() < rp.now + (uint32_t)(ts - rp.ts_last))
+			return;
+
+		switch (rp.hdr[1]) {
+		case TRACE_RAW:
+			n = rp.len / 2;
+			if (injecting()) {
+				rp.st.injected_bytes += n;
+				break;
+			}
+			rd = cap[0].rd;
+			if ((int32_t)(cap[1].rd - rd) < 0)
+				rd = cap[1].rd;
+			if (CAP_RING_LEN - (rp.wr - rd) < n)
+				return;
+			for (k = 0; k < n; k++) {
+				off = (rp.wr + k) & CAP_RING_MASK;
+				rp.ring[0][off] = rp.data[k];
+				rp.ring[1][off] = rp.data[n + k];
+			}
+			rp.wr += n;
+			rp.st.raw_bytes += n;
+			break;
+		case TRACE_PIN:
+			inj = injecting();
+			rp.irq1 = rp.data[0] & TRACE_PIN_NIRQ1;
+			rp.irqb = rp.data[0] & TRACE_PIN_NIRQB;
+			if (rp.len >= 2)
+				rp.mux = rp.data[1];
+			if (!inj && injecting())
+				rp.st.injected++;
+			rp.st.pin_changes++;
+			break;
+		case TRACE_DROP:
+			rp.st.drops++;
+			break;
+		}
+
+		if (rp.st.records)
+			rp.now += (uint32_t)(ts - rp.ts_last);
+		rp.ts_last = ts;
+		rp.st.records++;
+		rp.pending = false;
+	}
+}
+
+bool replay_done()
+{
+	return rp.eof && cap[0].rd == rp.wr && cap[1].rd == rp.wr;
+}
+
+const struct replay_stats *replay_get_stats()
+{
+	return &rp.st;
+}
+
+int hal_init()
+{
+	return 0;
+}
+
+uint8_t *hal_cap_buf(uint8_t spi)
+{
+	return rp.ring[spi];
+}
+
+uint32_t hal_cap_wr(uint8_t spi)
+{
+	if (spi == 0)
+		feed();
+	return rp.wr;
+}
+
+bool hal_spi_writable(uint8_t spi)
+{
+	return false;
+}
+
+void hal_spi_write(uint8_t spi, uint8_t c)
+{
+}
+
+void hal_mux_sel(uint8_t mux, bool inject)
+{
+}
+
+bool hal_irq1_get()
+{
+	return rp.irq1;
+}
+
+void hal_irqb_put(bool v)
+{
+}
+
+uint64_t hal_time_us()
+{
+	return rp.realtime ? wall_us() : rp.now;
+}
+
+void hal_barrier()
+{
+}
+
+void hal_notify()
+{
+}
+
+/* The records are fed as fast as the bridge takes them: nothing to wait for */
+void hal_wait(uint64_t until, bool bus)
+{
+}
+
+void hal_task()
+{
+}
+
+int hal_getchar()
+{
+	if (!rp.cmds || !*rp.cmds)
+		return -1;
+	return *rp.cmds++;
+}
+
+uint32_t hal_midi_read(uint8_t *buf, uint32_t len)
+{
+	return 0;
+}
+
+uint32_t hal_midi_write(const uint8_t *buf, uint32_t len)
+{
+	rp.st.usb_bytes += len;
+	return len;
+}
+
+uint32_t hal_raw_read(uint8_t *buf, uint32_t len)
+{
+	return 0;
+}
+
+uint32_t hal_raw_write(const uint8_t *buf, uint32_t len)
+{
+	rp.st.usb_bytes += len;
+	return len;
+}
+
+uint32_t hal_net_recv(uint8_t *buf, uint32_t size)
+{
+	return 0;
+}
+
+bool hal_net_send(const uint8_t *buf, uint32_t len)
+{
+	return true;
+}
+
+uint32_t hal_trace_write(const uint8_t *buf, uint32_t len)
+{
+	if (rp.trace_out)
+		fwrite(buf, 1, len, rp.trace_out);
+	return len;
+}
@@ -0,0 +1,190 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "hal.h"
+#include "sim.h"
+
+/* Every HAL call costs a bit of virtual time, so the busy loops of
+ * the bridge core advance the simulated bus.
+ */
+static uint32_t hal_cost_ns = 50;
+static FILE *trace_out;
+
+/* UDP stand-in of the Pico W network transport */
+static int udp_fd = -1;
+static struct sockaddr_in udp_peer;
+static bool udp_peer_valid;
+
+int hal_init()
+{
+	return 0;
+}
+
+uint8_t *hal_cap_buf(uint8_t spi)
+{
+	return sim_cap_buf(spi);
+}
+
+uint32_t hal_cap_wr(uint8_t spi)
+{
+	sim_advance(hal_cost_ns);
+	return sim_cap_wr(spi);
+}
+
+bool hal_spi_writable(uint8_t spi)
+{
+	sim_advance(hal_cost_ns);
+	return sim_spi_writable(spi);
+}
+
+void hal_spi_write(uint8_t spi, uint8_t c)
+{
+	sim_advance(hal_cost_ns);
+	sim_spi_write(spi, c);
+}
+
+void hal_mux_sel(uint8_t mux, bool inject)
+{
+	sim_advance(hal_cost_ns);
+	sim_mux_sel(mux, inject);
+}
+
+bool hal_irq1_get()
+{
+	sim_advance(hal_cost_ns);
+	return sim_irq1_get();
+}
+
+void hal_irqb_put(bool v)
+{
+	sim_advance(hal_cost_ns);
+	sim_irqb_put(v);
+}
+
+uint64_t hal_time_us()
+{
+	sim_advance(hal_cost_ns);
+	return sim_now_ns() / 1000;
+}
+
+void hal_barrier()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+/* Single thread (MC_EN=0): the other core is never asleep */
+void hal_notify()
+{
+}
+
+/* Any event of the bus or the hosts stands for the interrupt */
+void hal_wait(uint64_t until, bool bus)
+{
+	sim_wait(until * 1000);
+}
+
+void hal_task()
+{
+	sim_advance(hal_cost_ns);
+}
+
+int hal_getchar()
+{
+	return sim_getchar();
+}
+
+uint32_t hal_midi_read(uint8_t *buf, uint32_t len)
+{
+	sim_advance(hal_cost_ns);
+	return sim_midi_read(buf, len);
+}
+
+uint32_t hal_midi_write(const uint8_t *buf, uint32_t len)
+{
+	sim_advance(hal_cost_ns);
+	return sim_midi_write(buf, len);
+}
+
+uint32_t hal_raw_read(uint8_t *buf, uint32_t len)
+{
+	sim_advance(hal_cost_ns);
+	return sim_raw_read(buf, len);
+}
+
+uint32_t hal_raw_write(const uint8_t *buf, uint32_t len)
+{
+	sim_advance(hal_cost_ns);
+	return sim_raw_write(buf, len);
+}
+
+uint32_t hal_net_recv(uint8_t *buf, uint32_t size)
+{
+	socklen_t alen = sizeof(udp_peer);
+	ssize_t n;
+
+	sim_advance(hal_cost_ns);
+	if (udp_fd < 0)
+		return sim_net_recv(buf, size);
+
+	n = recvfrom(udp_fd, buf, size, 0, (struct sockaddr *)&udp_peer, &alen);
+	if (n <= 0)
+		return 0;
+	udp_peer_valid = true;
+	return n;
+}
+
+bool hal_net_send(const uint8_t *buf, uint32_t len)
+{
+	sim_advance(hal_cost_ns);
+	if (udp_fd < 0)
+		return sim_net_send(buf, len);
+
+	if (udp_peer_valid)
+		sendto(udp_fd, buf, len, 0, (struct sockaddr *)&udp_peer, sizeof(udp_peer));
+	return true;
+}
+
+uint32_t hal_trace_write(const uint8_t *buf, uint32_t len)
+{
+	sim_advance(hal_cost_ns);
+	if (trace_out)
+		fwrite(buf, 1, len, trace_out);
+	return len;
+}
+
+void hal_sim_set_cost(uint32_t ns)
+{
+	hal_cost_ns = ns;
+}
+
+void hal_sim_set_trace(FILE *f)
+{
+	trace_out = f;
+}
+
+int hal_sim_set_udp(uint16_t port)
+{
+	struct sockaddr_in a;
+
+	udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (udp_fd < 0)
+		return -1;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(port);
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(udp_fd, (struct sockaddr *)&a, sizeof(a)) < 0) {
+		close(udp_fd);
+		udp_fd = -1;
+		return -1;
+	}
+	fcntl(udp_fd, F_SETFL, O_NONBLOCK);
+	return 0;
+}
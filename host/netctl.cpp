@@ -0,0 +1,108 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <cstdint>
+
+#include "net.h"
+#include "sysex.h"
+
+/* UDP control client: every line of stdin is a datagram of SysEx frames
+ * in hex, separated by commas (F0 38 03 F7, F0 10 01 02 03 F7).
+ * Prints the frames of the received datagrams, each with the datagram seq
+ * and its stream:seq tag (stream 3: bridge notice).
+ */
+
+#define RECV_TIMEOUT_MS 50
+
+static void recv_all(int fd, struct net_seq *seq)
+{
+	uint8_t buf[NET_DGRAM_MAX];
+	struct pollfd p = {fd, POLLIN, 0};
+	struct net_rx r;
+	const uint8_t *m;
+	uint16_t s, len, tag, i;
+	ssize_t n;
+
+	while (poll(&p, 1, RECV_TIMEOUT_MS) > 0) {
+		n = recv(fd, buf, sizeof(buf), 0);
+		if (n <= 0)
+			break;
+		if (!net_rx_begin(&r, buf, n, &s)) {
+			fprintf(stderr, "malformed datagram, %zd bytes\n", n);
+			continue;
+		}
+		if (!net_seq_check(seq, s)) {
+			fprintf(stderr, "late datagram %u\n", s);
+			continue;
+		}
+		while (net_rx_next(&r, &m, &len, &tag)) {
+			printf("%5u %u:%-5u:", s, FRAME_TAG_STREAM(tag), FRAME_TAG_SEQ(tag));
+			for (i = 0; i < len; i++)
+				printf(" %02X", m[i]);
+			printf("\n");
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+	int port = argc > 2 ? atoi(argv[2]) : NET_PORT;
+	struct sockaddr_in a;
+	struct net_tx t;
+	struct net_seq seq;
+	uint8_t dgram[NET_DGRAM_MAX];
+	uint8_t msg[NET_DGRAM_MAX];
+	char line[4 * NET_DGRAM_MAX];
+	char *p, *end;
+	uint16_t len, tx_seq = 0;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(port);
+	if (fd < 0 || inet_pton(AF_INET, host, &a.sin_addr) != 1 ||
+			connect(fd, (struct sockaddr *)&a, sizeof(a)) < 0) {
+		fprintf(stderr, "%s:%d: %s\n", host, port, strerror(errno));
+		return 1;
+	}
+	net_seq_init(&seq);
+
+	while (fgets(line, sizeof(line), stdin)) {
+		net_tx_begin(&t, dgram, sizeof(dgram), tx_seq);
+		for (p = line; *p; ) {
+			len = 0;
+			while (len < sizeof(msg)) {
+				msg[len] = strtoul(p, &end, 16);
+				if (end == p)
+					break;
+				p = end;
+				len++;
+			}
+			if (len && !net_tx_put(&t, msg, len, 0))
+				fprintf(stderr, "datagram full\n");
+			if (*p == ',')
+				p++;
+			else
+				break;
+		}
+		if (t.frames) {
+			send(fd, dgram, t.len, 0);
+			tx_seq++;
+		}
+		recv_all(fd, &seq);
+	}
+	recv_all(fd, &seq);
+	if (seq.lost)
+		fprintf(stderr, "%u datagrams lost\n", seq.lost);
+
+	close(fd);
+	return 0;
+}
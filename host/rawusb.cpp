@@ -0,0 +1,270 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+#include <linux/usb/ch9.h>
+
+#include "rawusb.h"
+
+#define SYSFS_USB "/sys/bus/usb/devices"
+#define RAWUSB_PRODUCT "Pico-SL1602-SPIUSB"
+#define RAWUSB_READ 512
+
+static int sysfs_read(const char *dir, const char *name, char *buf, int size)
+{
+	char path[512];
+	FILE *f;
+	int n;
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+		return -1;
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	n = fread(buf, 1, size - 1, f);
+	fclose(f);
+	while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '))
+		n--;
+	buf[n] = 0;
+	return n;
+}
+
+static long sysfs_num(const char *dir, const char *name, int base)
+{
+	char buf[32];
+
+	if (sysfs_read(dir, name, buf, sizeof(buf)) <= 0)
+		return -1;
+	return strtol(buf, NULL, base);
+}
+
+/* Vendor interface with two bulk endpoints of a device in sysfs */
+static int find_itf(const char *dev, struct rawusb *d)
+{
+	char itf[512], ep[600];
+	const char *name = strrchr(dev, '/') + 1;
+	struct dirent *e, *f;
+	DIR *dir, *epdir;
+	long addr;
+
+	dir = opendir(dev);
+	if (!dir)
+		return -1;
+	while ((e = readdir(dir)) != NULL) {
+		if (strncmp(e->d_name, name, strlen(name)) || e->d_name[strlen(name)] != ':')
+			continue;
+		if (snprintf(itf, sizeof(itf), "%s/%s", dev, e->d_name) >= (int)sizeof(itf))
+			continue;
+		if (sysfs_num(itf, "bInterfaceClass", 16) != 0xFF ||
+				sysfs_num(itf, "bNumEndpoints", 16) != 2)
+			continue;
+
+		d->itf = sysfs_num(itf, "bInterfaceNumber", 16);
+		d->ep_in = d->ep_out = 0;
+		epdir = opendir(itf);
+		while (epdir && (f = readdir(epdir)) != NULL) {
+			if (strncmp(f->d_name, "ep_", 3))
+				continue;
+			if (snprintf(ep, sizeof(ep), "%s/%s", itf, f->d_name) >= (int)sizeof(ep))
+				continue;
+			addr = sysfs_num(ep, "bEndpointAddress", 16);
+			if (addr & 0x80)
+				d->ep_in = addr;
+			else if (addr > 0)
+				d->ep_out = addr;
+		}
+		if (epdir)
+			closedir(epdir);
+		if (d->ep_in && d->ep_out) {
+			closedir(dir);
+			return 0;
+		}
+	}
+	closedir(dir);
+	return -1;
+}
+
+static int find_dev(struct rawusb *d, char *node, int size)
+{
+	char dev[300], buf[64];
+	struct dirent *e;
+	DIR *dir;
+
+	dir = opendir(SYSFS_USB);
+	if (!dir)
+		return -1;
+	while ((e = readdir(dir)) != NULL) {
+		if (e->d_name[0] == '.' || strchr(e->d_name, ':'))
+			continue;
+		snprintf(dev, sizeof(dev), SYSFS_USB "/%s", e->d_name);
+		if (sysfs_num(dev, "idVendor", 16) != RAWUSB_VID ||
+				sysfs_num(dev, "idProduct", 16) != RAWUSB_PID)
+			continue;
+		if (sysfs_read(dev, "product", buf, sizeof(buf)) < 0 || strcmp(buf, RAWUSB_PRODUCT))
+			continue;
+		if (find_itf(dev, d))
+			continue;
+		snprintf(node, size, "/dev/bus/usb/%03ld/%03ld",
+				sysfs_num(dev, "busnum", 10), sysfs_num(dev, "devnum", 10));
+		closedir(dir);
+		return 0;
+	}
+	closedir(dir);
+	return -1;
+}
+
+/* Vendor interface with two bulk endpoints in the descriptors read from
+ * the usbfs node: the device descriptor, then the configuration ones
+ */
+static int find_itf_desc(int fd, struct rawusb *d)
+{
+	uint8_t buf[1024];
+	const uint8_t *p;
+	bool vendor = false;
+	int n, i;
+
+	n = read(fd, buf, sizeof(buf));
+	if (n < USB_DT_DEVICE_SIZE)
+		return -1;
+	for (i = buf[0]; i + 2 <= n && buf[i] >= 2 && i + buf[i] <= n; i += buf[i]) {
+		p = buf + i;
+		if (p[1] == USB_DT_INTERFACE && p[0] >= USB_DT_INTERFACE_SIZE) {
+			if (vendor && d->ep_in && d->ep_out)
+				break;
+			vendor = p[3] == 0 && p[4] == 2 && p[5] == USB_CLASS_VENDOR_SPEC;
+			d->itf = p[2];
+			d->ep_in = d->ep_out = 0;
+		} else if (p[1] == USB_DT_ENDPOINT && vendor &&
+				(p[3] & USB_ENDPOINT_XFERTYPE_MASK) == USB_ENDPOINT_XFER_BULK) {
+			if (p[2] & USB_DIR_IN)
+				d->ep_in = p[2];
+			else
+				d->ep_out = p[2];
+		}
+	}
+	return vendor && d->ep_in && d->ep_out ? 0 : -1;
+}
+
+int rawusb_open(struct rawusb *d, const char *path)
+{
+	char node[64];
+
+	memset(d, 0, sizeof(*d));
+	d->fd = -1;
+	if (!path && find_dev(d, node, sizeof(node)))
+		return -ENODEV;
+
+	d->fd = open(path ? path : node, O_RDWR);
+	if (d->fd < 0)
+		return -errno;
+	if (path && find_itf_desc(d->fd, d)) {
+		close(d->fd);
+		d->fd = -1;
+		return -ENODEV;
+	}
+	if (ioctl(d->fd, USBDEVFS_CLAIMINTERFACE, &d->itf) < 0) {
+		int err = -errno;
+
+		close(d->fd);
+		d->fd = -1;
+		return err;
+	}
+	return 0;
+}
+
+void rawusb_close(struct rawusb *d)
+{
+	if (d->fd < 0)
+		return;
+	ioctl(d->fd, USBDEVFS_RELEASEINTERFACE, &d->itf);
+	close(d->fd);
+	d->fd = -1;
+}
+
+static int bulk(struct rawusb *d, uint8_t ep, void *data, uint32_t len, unsigned timeout_ms)
+{
+	struct usbdevfs_bulktransfer bt;
+	int ret;
+
+	bt.ep = ep;
+	bt.len = len;
+	bt.timeout = timeout_ms;
+	bt.data = data;
+	ret = ioctl(d->fd, USBDEVFS_BULK, &bt);
+	if (ret < 0)
+		return errno == ETIMEDOUT ? 0 : -errno;
+	return ret;
+}
+
+uint32_t rawusb_encode(uint8_t *buf, const uint8_t *msg, uint16_t len)
+{
+	buf[0] = len;
+	buf[1] = len >> 8;
+	buf[2] = 0;
+	buf[3] = 0;
+	memcpy(buf + RAWUSB_HDR, msg, len);
+	return len + RAWUSB_HDR;
+}
+
+/* Returns the bytes of a complete frame at buf, 0 if more data is needed */
+int rawusb_decode(const uint8_t *buf, uint32_t len, const uint8_t **msg, uint16_t *msg_len, uint16_t *tag)
+{
+	uint16_t n;
+
+	if (len < RAWUSB_HDR)
+		return 0;
+	n = buf[0] | buf[1] << 8;
+	if (len < RAWUSB_HDR + (uint32_t)n)
+		return 0;
+	*msg = buf + RAWUSB_HDR;
+	*msg_len = n;
+	*tag = buf[2] | buf[3] << 8;
+	return n + RAWUSB_HDR;
+}
+
+int rawusb_send(struct rawusb *d, const uint8_t *msg, uint16_t len, unsigned timeout_ms)
+{
+	uint8_t buf[RAWUSB_FRAME_MAX + RAWUSB_HDR];
+	int ret;
+
+	if (len == 0 || len > RAWUSB_FRAME_MAX)
+		return -EINVAL;
+	len = rawusb_encode(buf, msg, len);
+	ret = bulk(d, d->ep_out, buf, len, timeout_ms);
+	if (ret < 0)
+		return ret;
+	return ret == len ? 0 : -EIO;
+}
+
+int rawusb_recv(struct rawusb *d, uint8_t *msg, uint16_t size, uint16_t *tag, unsigned timeout_ms)
+{
+	const uint8_t *m;
+	uint16_t n, t;
+	int k, ret;
+
+	for (;;) {
+		k = rawusb_decode(d->rx, d->rx_len, &m, &n, &t);
+		if (k > 0) {
+			if (tag)
+				*tag = t;
+			if (n > size)
+				n = size;
+			memcpy(msg, m, n);
+			d->rx_len -= k;
+			memmove(d->rx, d->rx + k, d->rx_len);
+			return n;
+		}
+		if (d->rx_len + RAWUSB_READ > sizeof(d->rx))
+			return -EPROTO;
+
+		ret = bulk(d, d->ep_in, d->rx + d->rx_len, RAWUSB_READ, timeout_ms);
+		if (ret <= 0)
+			return ret;
+		d->rx_len += ret;
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef _RAWUSB_H_
+#define _RAWUSB_H_
+
+#include <cstdint>
+
+/* Host side of the bridge vendor interface (Linux usbdevfs, no libusb).
+ * Frames are raw SysEx messages F0 .. F7 prefixed by their LE16 length
+ * and an LE16 tag: stream << 14 | seq from the bridge, 0 to the bridge.
+ */
+
+#define RAWUSB_VID 0x2E8A
+#define RAWUSB_PID 0x000A
+#define RAWUSB_FRAME_MAX 512
+#define RAWUSB_HDR 4
+
+struct rawusb {
+	int fd;
+	int itf;
+	uint8_t ep_in;
+	uint8_t ep_out;
+
+	/* Received stream, not yet returned as frames */
+	uint8_t rx[4096];
+	uint32_t rx_len;
+};
+
+/* Open the first bridge found in sysfs, or the usbfs node path (/dev/bus/usb/BBB/DDD)
+ * with the interface and endpoints from the descriptors of that node
+ */
+int rawusb_open(struct rawusb *d, const char *path);
+void rawusb_close(struct rawusb *d);
+
+/* Returns 0 or a negative errno */
+int rawusb_send(struct rawusb *d, const uint8_t *msg, uint16_t len, unsigned timeout_ms);
+
+/* Returns the frame length, 0 on timeout or a negative errno, tag may be NULL */
+int rawusb_recv(struct rawusb *d, uint8_t *msg, uint16_t size, uint16_t *tag, unsigned timeout_ms);
+
+/* Frame codec, also usable without the device */
+uint32_t rawusb_encode(uint8_t *buf, const uint8_t *msg, uint16_t len);
+int rawusb_decode(const uint8_t *buf, uint32_t len, const uint8_t **msg, uint16_t *msg_len, uint16_t *tag);
+
+#endif
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cstdint>
+
+#include "rawusb.h"
+
+/* Send SysEx messages given as hex lines on stdin (F0 38 03 F7) over the
+ * bridge vendor interface and print the received frames, each with its
+ * stream:seq tag (stream 3: bridge notice).
+ */
+
+#define RECV_TIMEOUT_MS 20
+
+static void print_frames(struct rawusb *d)
+{
+	uint8_t msg[RAWUSB_FRAME_MAX];
+	uint16_t tag;
+	int i, n;
+
+	while ((n = rawusb_recv(d, msg, sizeof(msg), &tag, RECV_TIMEOUT_MS)) > 0) {
+		printf("%u:%-5u:", tag >> 14, tag & 0x3FFF);
+		for (i = 0; i < n; i++)
+			printf(" %02X%s", msg[i], i == n - 1 ? "\n" : "");
+	}
+	if (n < 0)
+		fprintf(stderr, "recv: %s\n", strerror(-n));
+}
+
+int main(int argc, char *argv[])
+{
+	struct rawusb d;
+	char line[4 * RAWUSB_FRAME_MAX];
+	uint8_t msg[RAWUSB_FRAME_MAX];
+	char *p, *end;
+	uint16_t len;
+	int ret;
+
+	ret = rawusb_open(&d, argc > 1 ? argv[1] : NULL);
+	if (ret < 0) {
+		fprintf(stderr, "open: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), stdin)) {
+		len = 0;
+		for (p = line; len < sizeof(msg); p = end) {
+			msg[len] = strtoul(p, &end, 16);
+			if (end == p)
+				break;
+			len++;
+		}
+		if (len) {
+			ret = rawusb_send(&d, msg, len, 1000);
+			if (ret < 0)
+				fprintf(stderr, "send: %s\n", strerror(-ret));
+		}
+		print_frames(&d);
+	}
+	print_frames(&d);
+
+	rawusb_close(&d);
+	return 0;
+}
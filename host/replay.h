@@ -0,0 +1,22 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <cstdint>
+#include <cstdio>
+
+struct replay_stats {
+	uint64_t records;
+	uint64_t raw_bytes;             // byte pairs fed to the capture rings
+	uint64_t pin_changes;
+	uint64_t injected;              // transactions injected by the recorded bridge
+	uint64_t injected_bytes;        // their byte pairs, not fed
+	uint64_t drops;                 // gaps in the recording
+	uint64_t skipped;               // bytes outside of records
+	uint64_t usb_bytes;             // routed to USB-MIDI
+};
+
+void replay_open(FILE *f, bool realtime, const char *cmds, FILE *trace_out);
+bool replay_done();
+const struct replay_stats *replay_get_stats();
+
+#endif
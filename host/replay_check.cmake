@@ -0,0 +1,15 @@
+# Replay a recorded session and compare the decoded bridge trace with the golden file
+# cmake -DREPLAY=... -DDECODE=... -DSESSION=... -DGOLDEN=... -DOUT=... -P replay_check.cmake
+execute_process(COMMAND ${REPLAY} -c tf -o ${OUT}.bin ${SESSION}
+		OUTPUT_QUIET RESULT_VARIABLE ret)
+if(ret)
+	message(FATAL_ERROR "replay failed: ${ret}")
+endif()
+execute_process(COMMAND ${DECODE} ${OUT}.bin OUTPUT_FILE ${OUT}.txt RESULT_VARIABLE ret)
+if(ret)
+	message(FATAL_ERROR "decode failed: ${ret}")
+endif()
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUT}.txt ${GOLDEN} RESULT_VARIABLE ret)
+if(ret)
+	message(FATAL_ERROR "${OUT}.txt differs from ${GOLDEN}")
+endif()
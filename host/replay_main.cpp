@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+
+#include "hal.h"
+#include "bridge.h"
+#include "stats.h"
+#include "replay.h"
+
+/* Replay a recorded SPI session through the bridge core:
+ * framing, status filtering, routing and the log output.
+ */
+
+#define REPLAY_TAIL 1000        // passes after the end, so the queues are emptied
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"Usage: %s [options] FILE\n"
+			"-R       real time, as recorded (default: full speed)\n"
+			"-c CMDS  console commands fed to the bridge, e.g. tf for the binary log\n"
+			"-o FILE  binary trace output of the bridge\n",
+			name);
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+	int i;
+	bool realtime = false;
+	const char *cmds = "";
+	const char *out = NULL;
+	FILE *f;
+	FILE *out_f = NULL;
+	double secs;
+	const struct replay_stats *st;
+
+	while ((c = getopt(argc, argv, "Rc:o:h")) != -1) {
+		switch (c) {
+		case 'R': realtime = true; break;
+		case 'c': cmds = optarg; break;
+		case 'o': out = optarg; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (out) {
+		out_f = fopen(out, "wb");
+		if (!out_f) {
+			perror(out);
+			return 1;
+		}
+	}
+
+	replay_open(f, realtime, cmds, out_f);
+	hal_init();
+	bridge_init();
+
+	auto t0 = std::chrono::steady_clock::now();
+	while (!replay_done())
+		bridge_task();
+	for (i = 0; i < REPLAY_TAIL; i++)
+		bridge_task();
+	auto t1 = std::chrono::steady_clock::now();
+	secs = std::chrono::duration<double>(t1 - t0).count();
+
+	st = replay_get_stats();
+	printf("Records:       %llu, %llu pin changes, %llu gaps, %llu bytes skipped\n",
+			(unsigned long long)st->records, (unsigned long long)st->pin_changes,
+			(unsigned long long)st->drops, (unsigned long long)st->skipped);
+	printf("Replayed:      %llu byte pairs in %.3f s (%.2f MB/s)\n",
+			(unsigned long long)st->raw_bytes, secs, st->raw_bytes / secs / 1e6);
+	printf("Injected:      %llu transactions, %llu byte pairs not fed\n",
+			(unsigned long long)st->injected, (unsigned long long)st->injected_bytes);
+	printf("USB-MIDI:      %llu bytes routed\n", (unsigned long long)st->usb_bytes);
+	printf("Errors:        %04x, capture lost %lu %lu\n", err_get(),
+			(unsigned long)cap[0].lost, (unsigned long)cap[1].lost);
+	printf("\nBridge statistics\n");
+	stats_print(&stats);
+
+	if (out_f)
+		fclose(out_f);
+	fclose(f);
+	return 0;
+}
@@ -0,0 +1,791 @@
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "hal.h"
+#include "capture.h"
+#include "sysex.h"
+#include "bridge.h"
+#include "net.h"
+#include "sim.h"
+
+#define SIM_MSG_MAX     1024
+#define SIM_JUNK_MAX    32      // CPB gives up when no F0 comes within this count of bytes
+#define SIM_CPB_REACT_US 5      // CPB reaction time to the nIRQ
+#define SIM_USB_FIFO    48      // USB-MIDI OUT payload: 64 B packet, 3 of 4 bytes
+#define SIM_USB_EP      64      // USB-MIDI IN packet
+#define SIM_NEVER       UINT64_MAX
+
+enum {
+	M_IDLE,
+	M_WAIT,                 // nIRQ seen, reaction time
+	M_REQ,                  // clocking the request from the slave
+	M_TURN,                 // CPB processing
+	M_RES,                  // clocking the response to the slave
+};
+
+/* UDP datagram on the way */
+struct datagram {
+	uint64_t t;                     // arrival
+	std::vector<uint8_t> data;
+};
+
+/* Host request waiting for the response */
+struct pending {
+	uint64_t t;
+	uint8_t cmd;
+};
+
+/* Application on one of the bridge interfaces */
+struct host_client {
+	std::deque<struct pending> pending;
+	uint16_t msg_pos;               // position in the received message, 0 = outside
+	bool msg_ctl;
+	uint8_t msg_cmd;
+	uint8_t msg_arg[5];             // bridge message arguments
+	bool tagged;                    // frames come with a FRAME_TAG (vendor interface, network)
+	uint16_t tag;                   // of the received message
+	uint16_t seq[STREAMS];          // expected seq of the next frame of each stream
+};
+
+/* USB-MIDI 1.0 event packet: up to three SysEx bytes */
+struct usb_event {
+	uint8_t n;
+	uint8_t b[3];
+};
+
+static struct {
+	struct sim_config cfg;
+	struct sim_stats st;
+	const char *cmds;
+	std::mt19937 rng;
+
+	uint64_t now;
+	uint64_t byte_ns;
+	uint64_t t_master;
+	uint64_t t_poll;
+	uint64_t t_write;
+	uint64_t t_host;
+	uint64_t t_usb;
+	uint64_t t_next;
+
+	/* CPB */
+	int m;
+	bool m_pico;            // request came from the bridge
+	uint8_t mreq[SIM_MSG_MAX];
+	uint16_t mreq_len;
+	uint16_t junk;
+	uint8_t mres[SIM_MSG_MAX];
+	uint16_t mres_len;
+	uint16_t mres_pos;
+	uint8_t status[BUF_STATUS_LEN];
+
+	/* DSPB */
+	bool d_irq;             // nIRQ1 asserted (request pending)
+	std::deque<std::vector<uint8_t>> d_queue;
+	std::vector<uint8_t> d_cur;
+	uint16_t d_pos;
+
+	/* Bridge pins and SPI */
+	uint8_t mux;
+	bool irqb;
+	uint8_t tx[8];
+	uint8_t tx_rd;
+	uint8_t tx_wr;
+	alignas(CAP_RING_LEN) uint8_t ring[2][CAP_RING_LEN];
+	uint32_t wr[2];
+
+	/* USB host */
+	std::deque<uint8_t> usb_out[2];         // CLIENT_MIDI, CLIENT_RAW
+	std::deque<struct usb_event> usb_in;    // TX FIFO of the class driver
+	std::vector<struct usb_event> usb_pkt;  // IN transfer armed, sent on the next poll
+	struct usb_event usb_ev;                // event being packed
+	std::deque<uint8_t> raw_in;             // TX FIFO of the vendor interface
+	std::vector<uint8_t> raw_pkt;
+	uint32_t raw_hdr;                       // header bytes of the received frame
+	uint16_t raw_len;                       // frame bytes still to be received
+	uint16_t raw_tag;
+
+	/* Network host */
+	std::deque<struct datagram> net_out;    // to the bridge
+	std::deque<struct datagram> net_in;     // from the bridge
+	uint8_t net_dgram[NET_DGRAM_MAX];
+	struct net_tx net_tx;
+	uint16_t net_seq_tx;
+	struct net_seq net_seq_rx;
+	struct host_client host[CLIENTS];
+	uint8_t host_next;              // client of the next request
+	uint8_t drag_value;             // fader moved by the host
+} sim;
+
+void sim_default_config(struct sim_config *cfg)
+{
+	cfg->sck_hz = 2000000;
+	cfg->byte_gap_ns = 2000;
+	cfg->cpb_turnaround_us = 50;
+	cfg->dspb_poll_us = 20000;
+	cfg->dspb_writes_per_s = 50;
+	cfg->host_reqs_per_s = 100;
+	cfg->host_burst = 1;
+	cfg->host_start_us = 500000;
+	cfg->host_subscribe = 0;
+	cfg->host_drag = 0;
+	cfg->host_clients = CLIENT_BIT(CLIENT_MIDI);
+	cfg->net_latency_us = 300;
+	cfg->usb_packet_us = 125;
+	cfg->usb_tx_fifo = 512;
+	cfg->hal_cost_ns = 50;
+	cfg->seed = 1;
+}
+
+static bool nirq0()
+{
+	return (sim.mux & HAL_MUX_NIRQ0) ? sim.irqb : !sim.d_irq;
+}
+
+static bool dspb_selected()
+{
+	return !(sim.mux & HAL_MUX_NSS1);
+}
+
+static uint64_t period_ns(uint32_t per_s)
+{
+	return per_s ? 1000000000ull / per_s : SIM_NEVER;
+}
+
+static void sched()
+{
+	uint64_t t = sim.t_master;
+
+	if (sim.m == M_IDLE && !nirq0()) {
+		sim.m = M_WAIT;
+		sim.t_master = sim.now + SIM_CPB_REACT_US * 1000;
+		t = sim.t_master;
+	}
+	if (sim.t_poll < t)
+		t = sim.t_poll;
+	if (sim.t_write < t)
+		t = sim.t_write;
+	if (sim.t_host < t)
+		t = sim.t_host;
+	if (sim.t_usb < t)
+		t = sim.t_usb;
+	if (!sim.net_in.empty() && sim.net_in.front().t < t)
+		t = sim.net_in.front().t;
+	sim.t_next = t;
+}
+
+/* One byte on the wire: both bridge SPI slaves receive it */
+static void bus_clock(uint8_t mosi, uint8_t dspb_miso)
+{
+	sim.ring[0][sim.wr[0]++ & CAP_RING_MASK] = mosi;
+	sim.ring[1][sim.wr[1]++ & CAP_RING_MASK] = dspb_miso;
+	sim.st.bytes++;
+}
+
+static uint8_t dspb_miso()
+{
+	if (!dspb_selected() || !sim.d_irq || sim.d_pos >= sim.d_cur.size())
+		return 0x00;
+	return sim.d_cur[sim.d_pos++];
+}
+
+static uint8_t bridge_miso()
+{
+	uint8_t c;
+
+	if (sim.tx_rd == sim.tx_wr)
+		return 0x00;    // TX underrun
+	c = sim.tx[sim.tx_rd % sizeof(sim.tx)];
+	sim.tx_rd++;
+	return c;
+}
+
+static void dspb_next()
+{
+	/* One transaction at a time: busy until the response is clocked */
+	if (sim.d_irq || !sim.d_cur.empty() || sim.d_queue.empty())
+		return;
+	sim.d_cur = sim.d_queue.front();
+	sim.d_queue.pop_front();
+	sim.d_pos = 0;
+	sim.d_irq = true;
+}
+
+static void cpb_respond()
+{
+	uint16_t i;
+
+	if (sim.mreq_len == 4 && sim.mreq[1] == 0x38 && sim.mreq[2] == 0x03) {
+		/* Status: mostly unchanged, sometimes a meter moves */
+		if (sim.rng() % 5 == 0)
+			sim.status[3 + sim.rng() % (BUF_STATUS_LEN - 4)] = sim.rng() & 0x7F;
+		memcpy(sim.mres, sim.status, BUF_STATUS_LEN);
+		sim.mres_len = BUF_STATUS_LEN;
+	} else {
+		/* Generic acknowledge */
+		i = 0;
+		sim.mres[i++] = 0xF0;
+		sim.mres[i++] = (sim.mreq[1] + 1) & 0x7F;
+		sim.mres[i++] = sim.mreq_len > 3 ? sim.mreq[2] : 0;
+		sim.mres[i++] = 0x00;
+		sim.mres[i++] = 0xF7;
+		sim.mres_len = i;
+	}
+	sim.mres_pos = 0;
+}
+
+static void master_step()
+{
+	uint8_t miso, dmiso;
+
+	switch (sim.m) {
+	case M_WAIT:
+		if (nirq0()) {
+			sim.m = M_IDLE;
+			sim.t_master = SIM_NEVER;
+			break;
+		}
+		sim.m = M_REQ;
+		sim.mreq_len = 0;
+		sim.junk = 0;
+		sim.t_master = sim.now + sim.byte_ns;
+		break;
+
+	case M_REQ:
+		dmiso = dspb_miso();
+		sim.m_pico = sim.mux & HAL_MUX_MISO0;
+		miso = sim.m_pico ? bridge_miso() : dmiso;
+		bus_clock(0x00, dmiso);
+		sim.t_master = sim.now + sim.byte_ns;
+
+		if (sim.mreq_len == 0 && miso != 0xF0) {
+			if (++sim.junk > SIM_JUNK_MAX) {
+				sim.st.aborted_tr++;
+				sim.m = M_IDLE;
+				sim.t_master = SIM_NEVER;
+			}
+			break;
+		}
+		sim.mreq[sim.mreq_len++] = miso;
+		if (miso == 0xF7) {
+			/* Whole request pulled: the slave releases the nIRQ */
+			if (!sim.m_pico)
+				sim.d_irq = false;
+			sim.m = M_TURN;
+			sim.t_master = sim.now + sim.cfg.cpb_turnaround_us * 1000ull;
+		} else if (sim.mreq_len >= SIM_MSG_MAX) {
+			sim.st.aborted_tr++;
+			sim.m = M_IDLE;
+			sim.t_master = SIM_NEVER;
+		}
+		break;
+
+	case M_TURN:
+		cpb_respond();
+		sim.m = M_RES;
+		sim.t_master = sim.now + sim.byte_ns;
+		break;
+
+	case M_RES:
+		bus_clock(sim.mres[sim.mres_pos++], 0x00);
+		sim.t_master = sim.now + sim.byte_ns;
+		if (sim.mres_pos < sim.mres_len)
+			break;
+
+		if (sim.m_pico) {
+			sim.st.inject_tr++;
+		} else {
+			sim.st.native_tr++;
+			sim.d_cur.clear();
+			dspb_next();
+		}
+		sim.m = M_IDLE;
+		sim.t_master = SIM_NEVER;
+		break;
+	}
+}
+
+static void dspb_write()
+{
+	std::vector<uint8_t> m = {0xF0, 0x10, 0, 0, 0, 0xF7};
+
+	m[2] = sim.rng() % 16;
+	m[3] = sim.rng() % 64;
+	m[4] = sim.rng() & 0x7F;
+	sim.d_queue.push_back(m);
+}
+
+/* Network host: the messages put since the last flush go in one datagram */
+static void host_flush()
+{
+	if (sim.net_tx.frames) {
+		sim.net_out.push_back({sim.now + sim.cfg.net_latency_us * 1000ull,
+				std::vector<uint8_t>(sim.net_dgram, sim.net_dgram + sim.net_tx.len)});
+		sim.st.net_sent++;
+	}
+	net_tx_begin(&sim.net_tx, sim.net_dgram, sizeof(sim.net_dgram), sim.net_seq_tx++);
+}
+
+/* Message from a host client, with the length and tag prefix on the vendor interface */
+static void host_put(uint8_t client, const uint8_t *m, uint16_t len)
+{
+	if (client == CLIENT_NET) {
+		if (!net_tx_put(&sim.net_tx, m, len, 0)) {
+			host_flush();
+			net_tx_put(&sim.net_tx, m, len, 0);
+		}
+		return;
+	}
+	if (client == CLIENT_RAW) {
+		sim.usb_out[client].push_back(len);
+		sim.usb_out[client].push_back(len >> 8);
+		sim.usb_out[client].push_back(0);
+		sim.usb_out[client].push_back(0);
+	}
+	sim.usb_out[client].insert(sim.usb_out[client].end(), m, m + len);
+}
+
+/* Next client of the host, round robin */
+static uint8_t host_client()
+{
+	do {
+		sim.host_next = (sim.host_next + 1) % CLIENTS;
+	} while (!(sim.cfg.host_clients & CLIENT_BIT(sim.host_next)));
+	return sim.host_next;
+}
+
+static void host_send()
+{
+	uint32_t i;
+	uint8_t c;
+	uint8_t m[6] = {0xF0, 0x10, 0, 0, 0, 0xF7};
+	const uint8_t status_req[4] = {0xF0, 0x38, 0x03, 0xF7};
+
+	for (i = 0; i < sim.cfg.host_burst; i++) {
+		c = host_client();
+		if (sim.rng() % 2) {
+			host_put(c, status_req, sizeof(status_req));
+			sim.host[c].pending.push_back({sim.now, status_req[1]});
+		} else {
+			if (sim.rng() % 100 < sim.cfg.host_drag) {
+				m[2] = 0;
+				m[3] = 0;
+				m[4] = ++sim.drag_value & 0x7F;
+			} else {
+				m[2] = sim.rng() % 16;
+				m[3] = sim.rng() % 64;
+				m[4] = sim.rng() & 0x7F;
+			}
+			host_put(c, m, sizeof(m));
+			sim.host[c].pending.push_back({sim.now, m[1]});
+		}
+		sim.st.host_sent++;
+	}
+	if (sim.cfg.host_clients & CLIENT_BIT(CLIENT_NET))
+		host_flush();
+}
+
+/* Frames of the stream up to seq are lost without a notice when they did not arrive */
+static void host_seq(struct host_client *h, uint8_t stream, uint16_t seq, uint16_t n)
+{
+	sim.st.host_unreported += FRAME_TAG_SEQ(seq - h->seq[stream]);
+	h->seq[stream] = FRAME_TAG_SEQ(seq + n);
+}
+
+static void host_recv(uint8_t client, uint8_t c)
+{
+	struct host_client *h = &sim.host[client];
+	uint64_t lat;
+	uint8_t b;
+	std::deque<struct pending>::iterator p;
+
+	sim.st.usb_bytes++;
+	if (c == 0xF0) {
+		h->msg_pos = 1;
+		return;
+	}
+	if (!h->msg_pos)
+		return;
+	if (h->msg_pos == 1) {
+		h->msg_ctl = c == BRIDGE_SYSEX_ID;
+		h->msg_cmd = c;
+	} else if (h->msg_ctl && h->msg_pos == 2) {
+		h->msg_cmd = c;
+	} else if (h->msg_ctl && h->msg_pos < 3 + sizeof(h->msg_arg) && c != 0xF7) {
+		h->msg_arg[h->msg_pos - 3] = c;
+	}
+	h->msg_pos++;
+	if (c != 0xF7)
+		return;
+
+	h->msg_pos = 0;
+	if (h->tagged && FRAME_TAG_STREAM(h->tag) < STREAMS)
+		host_seq(h, FRAME_TAG_STREAM(h->tag), FRAME_TAG_SEQ(h->tag), 1);
+	if (h->msg_ctl) {
+		/* F0 7D 14 <stream> <seq LE14> <count LE14> F7 */
+		if (h->msg_cmd == BRIDGE_CMD_LOST && h->msg_arg[0] < STREAMS) {
+			sim.st.host_lost[h->msg_arg[0]] += h->msg_arg[3] | h->msg_arg[4] << 7;
+			if (h->tagged)
+				host_seq(h, h->msg_arg[0], h->msg_arg[1] | h->msg_arg[2] << 7,
+						h->msg_arg[3] | h->msg_arg[4] << 7);
+		}
+		sim.st.host_ctl++;
+		return;
+	}
+
+	/* The oldest request of the kind, others may be served first */
+	sim.st.host_recv++;
+	for (p = h->pending.begin(); p != h->pending.end(); p++) {
+		if (((p->cmd + 1) & 0x7F) == h->msg_cmd)
+			break;
+	}
+	if (p == h->pending.end()) {
+		sim.st.host_stray++;
+		return;
+	}
+	lat = (sim.now - p->t) / 1000;
+	h->pending.erase(p);
+
+	if (h->msg_cmd != 0x39) {
+		sim.st.wlat_sum_us += lat;
+		sim.st.wlat_n++;
+		if (lat > sim.st.wlat_max_us)
+			sim.st.wlat_max_us = lat;
+	}
+	sim.st.lat_sum_us += lat;
+	if (lat > sim.st.lat_max_us)
+		sim.st.lat_max_us = lat;
+	for (b = 0; b < 31 && (lat >> b) > 1; b++);
+	sim.st.lat_hist[b]++;
+}
+
+/* Arm an IN transfer with the FIFO content, when there is none pending */
+static void usb_flush()
+{
+	while (sim.usb_pkt.size() < SIM_USB_EP / 4 && !sim.usb_in.empty()) {
+		sim.usb_pkt.push_back(sim.usb_in.front());
+		sim.usb_in.pop_front();
+	}
+}
+
+static void host_recv_net(const std::vector<uint8_t> &d)
+{
+	struct net_rx r;
+	const uint8_t *m;
+	uint16_t seq, len, tag, i;
+
+	sim.st.net_recv++;
+	if (!net_rx_begin(&r, d.data(), d.size(), &seq) || !net_seq_check(&sim.net_seq_rx, seq))
+		return;
+	while (net_rx_next(&r, &m, &len, &tag)) {
+		sim.host[CLIENT_NET].tag = tag;
+		for (i = 0; i < len; i++)
+			host_recv(CLIENT_NET, m[i]);
+		sim.st.net_frames++;
+	}
+}
+
+/* Vendor interface: strip the length and tag prefix */
+static void host_recv_raw(uint8_t c)
+{
+	if (sim.raw_hdr < 2) {
+		sim.raw_len |= c << (8 * sim.raw_hdr++);
+		return;
+	}
+	if (sim.raw_hdr < RAW_HDR) {
+		sim.raw_tag |= c << (8 * (sim.raw_hdr++ - 2));
+		if (sim.raw_hdr == RAW_HDR) {
+			sim.host[CLIENT_RAW].tag = sim.raw_tag;
+			sim.raw_tag = 0;
+		}
+		return;
+	}
+	host_recv(CLIENT_RAW, c);
+	if (--sim.raw_len == 0)
+		sim.raw_hdr = 0;
+}
+
+static void raw_flush()
+{
+	while (sim.raw_pkt.size() < SIM_USB_EP && !sim.raw_in.empty()) {
+		sim.raw_pkt.push_back(sim.raw_in.front());
+		sim.raw_in.pop_front();
+	}
+}
+
+static void usb_step()
+{
+	uint32_t i;
+	uint8_t j;
+
+	for (i = 0; i < sim.raw_pkt.size(); i++)
+		host_recv_raw(sim.raw_pkt[i]);
+	if (!sim.raw_pkt.empty())
+		sim.st.usb_packets++;
+	sim.raw_pkt.clear();
+	raw_flush();
+
+	/* IN token: the armed transfer completes, the next one starts from the FIFO */
+	for (i = 0; i < sim.usb_pkt.size(); i++) {
+		for (j = 0; j < sim.usb_pkt[i].n; j++)
+			host_recv(CLIENT_MIDI, sim.usb_pkt[i].b[j]);
+	}
+	if (!sim.usb_pkt.empty())
+		sim.st.usb_packets++;
+	sim.usb_pkt.clear();
+	usb_flush();
+	sim.t_usb = sim.now + sim.cfg.usb_packet_us * 1000ull;
+}
+
+static void step()
+{
+	if (sim.t_master <= sim.now)
+		master_step();
+	if (sim.t_poll <= sim.now) {
+		sim.d_queue.push_back({0xF0, 0x38, 0x03, 0xF7});
+		sim.t_poll = sim.now + sim.cfg.dspb_poll_us * 1000ull;
+	}
+	if (sim.t_write <= sim.now) {
+		dspb_write();
+		sim.t_write = sim.now + period_ns(sim.cfg.dspb_writes_per_s);
+	}
+	if (sim.t_host <= sim.now) {
+		host_send();
+		sim.t_host = sim.now + period_ns(sim.cfg.host_reqs_per_s) * sim.cfg.host_burst;
+	}
+	if (sim.t_usb <= sim.now)
+		usb_step();
+	while (!sim.net_in.empty() && sim.net_in.front().t <= sim.now) {
+		host_recv_net(sim.net_in.front().data);
+		sim.net_in.pop_front();
+	}
+	dspb_next();
+}
+
+void sim_init(const struct sim_config *cfg, const char *cmds)
+{
+	uint8_t i, c;
+	uint8_t m[11];
+
+	sim.cfg = *cfg;
+	sim.cmds = cmds;
+	sim.rng.seed(cfg->seed);
+	memset(&sim.st, 0, sizeof(sim.st));
+
+	sim.now = 0;
+	sim.byte_ns = 8000000000ull / cfg->sck_hz + cfg->byte_gap_ns;
+	sim.m = M_IDLE;
+	sim.t_master = SIM_NEVER;
+	sim.t_poll = cfg->dspb_poll_us ? cfg->dspb_poll_us * 1000ull : SIM_NEVER;
+	sim.t_write = period_ns(cfg->dspb_writes_per_s);
+	sim.t_host = cfg->host_reqs_per_s ? cfg->host_start_us * 1000ull : SIM_NEVER;
+	sim.t_usb = cfg->usb_packet_us * 1000ull;
+
+	sim.status[0] = 0xF0;
+	sim.status[1] = 0x39;
+	sim.status[2] = 0x03;
+	for (i = 3; i < BUF_STATUS_LEN - 1; i++)
+		sim.status[i] = sim.rng() & 0x7F;
+	sim.status[BUF_STATUS_LEN - 1] = 0xF7;
+
+	sim.net_seq_tx = 0;
+	net_seq_init(&sim.net_seq_rx);
+	net_tx_begin(&sim.net_tx, sim.net_dgram, sizeof(sim.net_dgram), sim.net_seq_tx++);
+	sim.host_next = CLIENTS - 1;
+	for (c = 0; c < CLIENTS; c++) {
+		sim.host[c].pending.clear();
+		sim.host[c].msg_pos = 0;
+		sim.host[c].tagged = c != CLIENT_MIDI;
+		memset(sim.host[c].seq, 0, sizeof(sim.host[c].seq));
+	}
+	sim.raw_hdr = 0;
+	sim.raw_tag = 0;
+
+	/* Every host client subscribes */
+	if (cfg->host_subscribe) {
+		m[0] = 0xF0;
+		m[1] = BRIDGE_SYSEX_ID;
+		m[2] = BRIDGE_CMD_SUBSCRIBE;
+		for (i = 0; i < 7; i++)
+			m[3 + i] = (cfg->host_subscribe >> (7 * i)) & 0x7F;
+		m[10] = 0xF7;
+		for (c = 0; c < CLIENTS; c++) {
+			if (cfg->host_clients & CLIENT_BIT(c))
+				host_put(c, m, sizeof(m));
+		}
+		if (cfg->host_clients & CLIENT_BIT(CLIENT_NET))
+			host_flush();
+	}
+
+	sim.mux = 0;
+	sim.irqb = 1;
+	hal_sim_set_cost(cfg->hal_cost_ns);
+	sched();
+}
+
+void sim_advance(uint32_t ns)
+{
+	uint64_t t = sim.now + ns;
+
+	while (sim.t_next <= t) {
+		sim.now = sim.t_next;
+		step();
+		sched();
+	}
+	sim.now = t;
+}
+
+/* Idle bridge: the time skips to the next event, t (ns) at the latest */
+void sim_wait(uint64_t t)
+{
+	if (sim.t_next < t)
+		t = sim.t_next;
+	if (!sim.net_out.empty() && sim.net_out.front().t < t)
+		t = sim.net_out.front().t;
+	if (t > sim.now)
+		sim_advance(t - sim.now);
+}
+
+uint64_t sim_now_ns()
+{
+	return sim.now;
+}
+
+const struct sim_stats *sim_get_stats()
+{
+	return &sim.st;
+}
+
+uint8_t *sim_cap_buf(uint8_t spi)
+{
+	return sim.ring[spi];
+}
+
+uint32_t sim_cap_wr(uint8_t spi)
+{
+	return sim.wr[spi];
+}
+
+bool sim_spi_writable(uint8_t spi)
+{
+	return spi == HAL_SPI_CPB && (uint8_t)(sim.tx_wr - sim.tx_rd) < sizeof(sim.tx);
+}
+
+void sim_spi_write(uint8_t spi, uint8_t c)
+{
+	if (!sim_spi_writable(spi))
+		return;
+	sim.tx[sim.tx_wr % sizeof(sim.tx)] = c;
+	sim.tx_wr++;
+}
+
+void sim_mux_sel(uint8_t mux, bool inject)
+{
+	if (inject)
+		sim.mux |= mux;
+	else
+		sim.mux &= ~mux;
+	sched();
+}
+
+bool sim_irq1_get()
+{
+	return !sim.d_irq;
+}
+
+void sim_irqb_put(bool v)
+{
+	sim.irqb = v;
+	sched();
+}
+
+int sim_getchar()
+{
+	if (!sim.cmds || !*sim.cmds)
+		return -1;
+	return *sim.cmds++;
+}
+
+uint32_t sim_midi_read(uint8_t *buf, uint32_t len)
+{
+	uint32_t i;
+
+	if (len > SIM_USB_FIFO)
+		len = SIM_USB_FIFO;
+	for (i = 0; i < len && !sim.usb_out[CLIENT_MIDI].empty(); i++) {
+		buf[i] = sim.usb_out[CLIENT_MIDI].front();
+		sim.usb_out[CLIENT_MIDI].pop_front();
+	}
+	return i;
+}
+
+uint32_t sim_midi_write(const uint8_t *buf, uint32_t len)
+{
+	uint32_t i;
+
+	/* Every write flushes, as tud_midi_n_stream_write does */
+	for (i = 0; i < len && sim.usb_in.size() < sim.cfg.usb_tx_fifo / 4; i++) {
+		sim.usb_ev.b[sim.usb_ev.n++] = buf[i];
+		if (sim.usb_ev.n == 3 || buf[i] == 0xF7) {
+			sim.usb_in.push_back(sim.usb_ev);
+			sim.usb_ev.n = 0;
+		}
+	}
+	if (sim.usb_pkt.empty())
+		usb_flush();
+	return i;
+}
+
+uint32_t sim_raw_read(uint8_t *buf, uint32_t len)
+{
+	uint32_t i;
+
+	if (len > SIM_USB_EP)
+		len = SIM_USB_EP;
+	for (i = 0; i < len && !sim.usb_out[CLIENT_RAW].empty(); i++) {
+		buf[i] = sim.usb_out[CLIENT_RAW].front();
+		sim.usb_out[CLIENT_RAW].pop_front();
+	}
+	return i;
+}
+
+uint32_t sim_raw_write(const uint8_t *buf, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len && sim.raw_in.size() < sim.cfg.usb_tx_fifo; i++)
+		sim.raw_in.push_back(buf[i]);
+	if (sim.raw_pkt.empty())
+		raw_flush();
+	return i;
+}
+
+uint32_t sim_net_recv(uint8_t *buf, uint32_t size)
+{
+	uint32_t len;
+
+	if (sim.net_out.empty() || sim.net_out.front().t > sim.now)
+		return 0;
+	len = sim.net_out.front().data.size();
+	if (len > size)
+		len = size;
+	memcpy(buf, sim.net_out.front().data.data(), len);
+	sim.net_out.pop_front();
+	return len;
+}
+
+bool sim_net_send(const uint8_t *buf, uint32_t len)
+{
+	sim.net_in.push_back({sim.now + sim.cfg.net_latency_us * 1000ull,
+			std::vector<uint8_t>(buf, buf + len)});
+	sched();
+	return true;
+}
+
+const struct net_seq *sim_net_seq()
+{
+	return &sim.net_seq_rx;
+}
@@ -0,0 +1,90 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <cstdint>
+#include <cstdio>
+
+#include "sysex.h"
+
+/* Simulated SPI bus of the console: CPB (AT91SAM, SPI master) and
+ * DSPB (TC2210, SPI slave) with the bridge muxes in between, plus
+ * a USB-MIDI host injecting requests.
+ *
+ * The simulation runs in virtual time, which advances on every HAL call
+ * by the configured cost, so the results are deterministic.
+ */
+
+struct net_seq;
+
+struct sim_config {
+	uint32_t sck_hz;                // SPI clock
+	uint32_t byte_gap_ns;           // gap between bytes (nSS toggling)
+	uint32_t cpb_turnaround_us;     // CPB processing between request and response
+	uint32_t dspb_poll_us;          // period of DSPB status requests
+	uint32_t dspb_writes_per_s;     // other DSPB requests
+	uint32_t host_reqs_per_s;       // requests injected from the USB host
+	uint32_t host_burst;            // requests sent in one USB write
+	uint32_t host_start_us;         // first host request
+	uint64_t host_subscribe;        // status fields subscribed by the host at start
+	uint32_t host_drag;             // host writes moving one fader (%)
+	uint8_t host_clients;           // CLIENT_BIT of the host clients, requests go round robin
+	uint32_t net_latency_us;        // one way UDP latency
+	uint32_t usb_packet_us;         // USB-MIDI IN packet interval
+	uint32_t usb_tx_fifo;           // USB-MIDI TX FIFO (bytes of 4-byte event packets)
+	uint32_t hal_cost_ns;           // virtual time of one HAL call
+	uint32_t seed;
+};
+
+struct sim_stats {
+	uint64_t native_tr;             // completed DSPB transactions
+	uint64_t inject_tr;             // completed transactions injected by the bridge
+	uint64_t aborted_tr;            // transactions without a valid request
+	uint64_t host_sent;             // requests sent by the USB host
+	uint64_t host_recv;             // responses received by the USB host
+	uint64_t host_ctl;              // bridge messages (F0 7D) received by the USB host
+	uint64_t host_stray;            // responses without a request of the client
+	uint64_t host_lost[STREAMS];    // frames reported lost by the bridge
+	uint64_t host_unreported;       // frames missing from the seq of a stream without a LOST notice
+	uint64_t usb_bytes;             // bytes received by the USB host
+	uint64_t usb_packets;           // USB-MIDI IN packets
+	uint64_t net_sent;              // datagrams sent by the network host
+	uint64_t net_recv;              // datagrams received by the network host
+	uint64_t net_frames;            // SysEx frames in the received datagrams
+	uint64_t lat_sum_us;
+	uint64_t lat_max_us;
+	uint64_t wlat_n;                // latency of the host writes
+	uint64_t wlat_sum_us;
+	uint64_t wlat_max_us;
+	uint32_t lat_hist[32];          // log2 buckets of the injection latency (us)
+	uint64_t bytes;                 // bytes clocked on the bus
+};
+
+void sim_default_config(struct sim_config *cfg);
+void sim_init(const struct sim_config *cfg, const char *cmds);
+void sim_advance(uint32_t ns);
+uint64_t sim_now_ns();
+void sim_wait(uint64_t t);
+const struct sim_stats *sim_get_stats();
+
+/* Bridge side of the bus, used by the HAL */
+uint8_t *sim_cap_buf(uint8_t spi);
+uint32_t sim_cap_wr(uint8_t spi);
+bool sim_spi_writable(uint8_t spi);
+void sim_spi_write(uint8_t spi, uint8_t c);
+void sim_mux_sel(uint8_t mux, bool inject);
+bool sim_irq1_get();
+void sim_irqb_put(bool v);
+int sim_getchar();
+uint32_t sim_midi_read(uint8_t *buf, uint32_t len);
+uint32_t sim_midi_write(const uint8_t *buf, uint32_t len);
+uint32_t sim_raw_read(uint8_t *buf, uint32_t len);
+uint32_t sim_raw_write(const uint8_t *buf, uint32_t len);
+uint32_t sim_net_recv(uint8_t *buf, uint32_t size);
+bool sim_net_send(const uint8_t *buf, uint32_t len);
+const struct net_seq *sim_net_seq();
+
+void hal_sim_set_cost(uint32_t ns);
+void hal_sim_set_trace(FILE *f);
+int hal_sim_set_udp(uint16_t port);     // serve the network transport on 127.0.0.1
+
+#endif
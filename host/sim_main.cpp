@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+
+#include "hal.h"
+#include "bridge.h"
+#include "stats.h"
+#include "net.h"
+#include "sim.h"
+
+/* Bridge core against the simulated console bus.
+ * Core1 work runs inline in bridge_task (MC_EN=0).
+ */
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"Usage: %s [options]\n"
+			"-t SEC   simulated duration (20)\n"
+			"-k HZ    SPI clock (2000000)\n"
+			"-g NS    gap between bytes (2000)\n"
+			"-T US    CPB turnaround (50)\n"
+			"-p US    DSPB status poll period, 0 = off (20000)\n"
+			"-w N     DSPB writes per second (50)\n"
+			"-r N     USB host requests per second (100)\n"
+			"-b N     USB host requests per burst (1)\n"
+			"-S US    first USB host request (500000)\n"
+			"-m MASK  status fields subscribed by the host, hex (0)\n"
+			"-d PCT   host writes dragging one fader (0)\n"
+			"-V       USB host on the vendor interface instead of USB-MIDI\n"
+			"-W       host on the UDP transport instead of USB-MIDI\n"
+			"-C MASK  host clients, hex, requests go round robin: 1 USB-MIDI, 2 vendor, 4 UDP (1)\n"
+			"-L US    one way UDP latency (300)\n"
+			"-P PORT  serve the UDP transport on 127.0.0.1, in real time\n"
+			"-u US    USB-MIDI IN packet interval (125)\n"
+			"-f N     USB-MIDI TX FIFO, bytes (512)\n"
+			"-n NS    virtual time of one HAL call (50)\n"
+			"-c CMDS  console commands fed to the bridge\n"
+			"-o FILE  binary trace output (console command t)\n"
+			"-s SEED  random seed (1)\n",
+			name);
+}
+
+struct hwm {
+	const char *name;
+	uint32_t max;
+	uint32_t depth;
+};
+
+static void hwm_update(struct hwm *h, uint32_t count, uint32_t depth)
+{
+	if (count > h->max)
+		h->max = count;
+	h->depth = depth;
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+	uint8_t i;
+	double dur = 20;
+	double secs;
+	const char *cmds = "";
+	const char *trace = NULL;
+	int port = 0;
+	FILE *trace_f = NULL;
+	uint64_t end;
+	const struct sim_stats *st;
+	struct sim_config cfg;
+	struct hwm hwm[3] = {{"IC"}, {"IJREQ"}, {"IJRES"}};
+
+	sim_default_config(&cfg);
+
+	while ((c = getopt(argc, argv, "t:k:g:T:p:w:r:b:S:m:d:VWC:L:P:u:f:n:c:o:s:h")) != -1) {
+		switch (c) {
+		case 't': dur = atof(optarg); break;
+		case 'k': cfg.sck_hz = atoi(optarg); break;
+		case 'g': cfg.byte_gap_ns = atoi(optarg); break;
+		case 'T': cfg.cpb_turnaround_us = atoi(optarg); break;
+		case 'p': cfg.dspb_poll_us = atoi(optarg); break;
+		case 'w': cfg.dspb_writes_per_s = atoi(optarg); break;
+		case 'r': cfg.host_reqs_per_s = atoi(optarg); break;
+		case 'b': cfg.host_burst = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+		case 'S': cfg.host_start_us = atoi(optarg); break;
+		case 'm': cfg.host_subscribe = strtoull(optarg, NULL, 16); break;
+		case 'd': cfg.host_drag = atoi(optarg); break;
+		case 'V': cfg.host_clients = CLIENT_BIT(CLIENT_RAW); break;
+		case 'W': cfg.host_clients = CLIENT_BIT(CLIENT_NET); break;
+		case 'C': cfg.host_clients = strtoul(optarg, NULL, 16) & 7; break;
+		case 'L': cfg.net_latency_us = atoi(optarg); break;
+		case 'P': port = atoi(optarg); break;
+		case 'u': cfg.usb_packet_us = atoi(optarg); break;
+		case 'f': cfg.usb_tx_fifo = atoi(optarg); break;
+		case 'n': cfg.hal_cost_ns = atoi(optarg); break;
+		case 'c': cmds = optarg; break;
+		case 'o': trace = optarg; break;
+		case 's': cfg.seed = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!cfg.host_clients) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (trace) {
+		trace_f = fopen(trace, "wb");
+		if (!trace_f) {
+			perror(trace);
+			return 1;
+		}
+		hal_sim_set_trace(trace_f);
+	}
+
+	if (port && hal_sim_set_udp(port)) {
+		perror("udp");
+		return 1;
+	}
+
+	sim_init(&cfg, cmds);
+	hal_init();
+	bridge_init();
+
+	end = (uint64_t)(dur * 1e9);
+	auto t0 = std::chrono::steady_clock::now();
+	while (sim_now_ns() < end) {
+		bridge_task();
+
+		/* Real time pace for the UDP clients */
+		if (port && std::chrono::steady_clock::now() - t0 <
+				std::chrono::nanoseconds(sim_now_ns()))
+			usleep(100);
+
+		hwm_update(&hwm[0], buf_ic0.count(), buf_ic0.depth());
+		hwm_update(&hwm[1], buf_ijreq.count(), buf_ijreq.depth());
+		hwm_update(&hwm[2], buf_ijres.count(), buf_ijres.depth());
+	}
+
+	st = sim_get_stats();
+	secs = sim_now_ns() / 1e9;
+
+	printf("Simulated:     %.3f s, %llu bytes on the bus\n", secs, (unsigned long long)st->bytes);
+	printf("Ready:         %s, after %lu us\n", ready_name(ready_by), (unsigned long)ready_us);
+	printf("Transactions:  %llu native (%.1f/s), %llu injected (%.1f/s), %llu aborted\n",
+			(unsigned long long)st->native_tr, st->native_tr / secs,
+			(unsigned long long)st->inject_tr, st->inject_tr / secs,
+			(unsigned long long)st->aborted_tr);
+	printf("USB host:      %llu sent, %llu received, %llu bridge messages, %llu bytes (%.0f B/s), %llu stray\n",
+			(unsigned long long)st->host_sent, (unsigned long long)st->host_recv,
+			(unsigned long long)st->host_ctl, (unsigned long long)st->usb_bytes, st->usb_bytes / secs,
+			(unsigned long long)st->host_stray);
+	if (st->host_lost[STREAM_RES] || st->host_lost[STREAM_DELTA] || st->host_lost[STREAM_MON])
+		printf("Reported lost: %llu responses, %llu deltas, %llu intercepted\n",
+				(unsigned long long)st->host_lost[STREAM_RES],
+				(unsigned long long)st->host_lost[STREAM_DELTA],
+				(unsigned long long)st->host_lost[STREAM_MON]);
+	if (cfg.host_clients & (CLIENT_BIT(CLIENT_RAW) | CLIENT_BIT(CLIENT_NET)))
+		printf("Stream seq:    %llu frames missing without a LOST notice\n",
+				(unsigned long long)st->host_unreported);
+	printf("USB IN:        %llu packets, %.1f SysEx bytes per packet\n",
+			(unsigned long long)st->usb_packets,
+			st->usb_packets ? (double)st->usb_bytes / st->usb_packets : 0.0);
+	if (st->host_recv) {
+		printf("Latency:       avg %llu us, max %llu us\n",
+				(unsigned long long)(st->lat_sum_us / st->host_recv),
+				(unsigned long long)st->lat_max_us);
+		if (st->wlat_n)
+			printf("  writes:      avg %llu us, max %llu us\n",
+					(unsigned long long)(st->wlat_sum_us / st->wlat_n),
+					(unsigned long long)st->wlat_max_us);
+		for (i = 0; i < 32; i++) {
+			if (st->lat_hist[i])
+				printf("  < %10lu us: %u\n", 2ul << i, st->lat_hist[i]);
+		}
+	}
+	if (cfg.host_clients & CLIENT_BIT(CLIENT_NET)) {
+		printf("Network:       %llu datagrams sent, %llu received, %.1f frames per datagram, %u lost, %u dropped\n",
+				(unsigned long long)st->net_sent, (unsigned long long)st->net_recv,
+				st->net_recv ? (double)st->net_frames / st->net_recv : 0.0,
+				sim_net_seq()->lost, sim_net_seq()->dropped);
+	}
+	printf("Queue max:    ");
+	for (i = 0; i < 3; i++)
+		printf(" %s %u/%u", hwm[i].name, hwm[i].max, hwm[i].depth);
+	printf("\n");
+	printf("Errors:        %04x, capture lost %lu %lu\n", err_get(),
+			(unsigned long)cap[0].lost, (unsigned long)cap[1].lost);
+
+	printf("\nBridge statistics\n");
+	stats_print(&stats);
+
+	if (trace_f)
+		fclose(trace_f);
+
+	return st->host_unreported ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/* Cycle model of spisniff.pio against SPI mode 0 waveforms: checks the
+ * bit order of the captured bytes and finds the SCK the program keeps up with.
+ *
+ * One PIO instruction per system clock cycle, WAIT stalls in place,
+ * the GPIO input synchronizer delays the pins by two cycles (unless bypassed).
+ * The data line changes on the falling SCK edge, delayed by the skew.
+ */
+
+enum op {
+	OP_WAIT,                // WAIT pol PIN idx
+	OP_MOV_ISR_NULL,
+	OP_JMP_PIN,             // JMP PIN target
+	OP_IN,                  // IN PINS 1
+};
+
+struct insn {
+	uint8_t op;
+	uint8_t pol;
+	uint8_t idx;
+	uint8_t target;
+};
+
+/* spisniff.pio, pins relative to IN base: data 0, nSS 1, SCK 2 */
+#define PIN_DATA 0
+#define PIN_NSS 1
+#define PIN_SCK 2
+
+static const struct insn prog[] = {
+	{OP_WAIT, 0, PIN_NSS, 0},       // entry
+	{OP_MOV_ISR_NULL, 0, 0, 0},
+	{OP_WAIT, 0, PIN_SCK, 0},       // .wrap_target
+	{OP_JMP_PIN, 0, 0, 0},
+	{OP_WAIT, 1, PIN_SCK, 0},
+	{OP_IN, 0, 0, 0},               // .wrap
+};
+#define PROG_WRAP_TARGET 2
+#define PROG_WRAP 5
+
+struct bus {
+	double t_sck;           // SCK period (ns)
+	double gap;             // nSS inactive between bytes (ns), 0: held active
+	double skew;            // data line delay after the falling edge (ns)
+	const std::vector<uint8_t> *data;
+};
+
+static double byte_period(const struct bus *b)
+{
+	/* Toggling nSS: half a period lead before the first rising edge */
+	return b->gap ? b->gap + 8.5 * b->t_sck : 8 * b->t_sck;
+}
+
+/* Pin levels at time t (ns) */
+static uint8_t bus_pins(const struct bus *b, double t)
+{
+	double T = b->t_sck;
+	double per = byte_period(b);
+	double w, e;
+	long i, k;
+	uint8_t pins = 0;
+
+	i = (long)floor(t / per);
+	if (t < 0 || i >= (long)b->data->size())
+		return 1 << PIN_NSS;
+	w = t - i * per - b->gap;       // from nSS active, from the byte start when held
+	if (w < 0 || (b->gap && w >= 8.5 * T))
+		pins |= 1 << PIN_NSS;
+
+	/* SCK high in [T/2 + kT, T + kT) */
+	e = w - 0.5 * T;
+	if (e >= 0 && e < 8 * T && fmod(e, T) < 0.5 * T)
+		pins |= 1 << PIN_SCK;
+
+	/* Bit k (MSB first) is driven from kT, before that the previous byte stays */
+	k = (long)floor((w - b->skew) / T);
+	if (k < 0) {
+		i--;
+		k = b->gap ? 7 : k + 8;
+	}
+	if (k > 7)
+		k = 7;
+	if (i >= 0 && i < (long)b->data->size() && ((*b->data)[i] & (0x80 >> k)))
+		pins |= 1 << PIN_DATA;
+	return pins;
+}
+
+struct result {
+	uint32_t bytes;
+	uint32_t errors;
+	long first;             // index of the first wrong byte, -1: none
+	uint8_t exp, got;
+};
+
+/* Run the program over the whole transfer */
+static struct result run(const struct bus *b, double sys_mhz, uint8_t sync)
+{
+	struct result r = {0, 0, -1, 0, 0};
+	const std::vector<uint8_t> &d = *b->data;
+	double cyc = 1000.0 / sys_mhz;
+	double end = (d.size() + 1) * byte_period(b);
+	uint64_t c;
+	uint8_t pc = 0;
+	uint8_t pins;
+	uint32_t isr = 0;
+	uint8_t count = 0;
+	bool stall;
+
+	for (c = 0; c * cyc < end; c++) {
+		pins = bus_pins(b, ((double)c - sync) * cyc);
+		stall = false;
+
+		switch (prog[pc].op) {
+		case OP_WAIT:
+			stall = ((pins >> prog[pc].idx) & 1) != prog[pc].pol;
+			break;
+		case OP_MOV_ISR_NULL:
+			isr = 0;
+			count = 0;
+			break;
+		case OP_JMP_PIN:
+			if (pins & (1 << PIN_NSS)) {
+				pc = prog[pc].target;
+				continue;
+			}
+			break;
+		case OP_IN:
+			isr = isr << 1 | (pins & 1);
+			if (++count == 8) {
+				/* Autopush */
+				if (r.bytes < d.size() && (uint8_t)isr != d[r.bytes]) {
+					if (r.first < 0) {
+						r.first = r.bytes;
+						r.exp = d[r.bytes];
+						r.got = isr;
+					}
+					r.errors++;
+				}
+				r.bytes++;
+				isr = 0;
+				count = 0;
+			}
+			break;
+		}
+		if (!stall)
+			pc = pc == PROG_WRAP ? PROG_WRAP_TARGET : pc + 1;
+	}
+	if (r.bytes != d.size())
+		r.errors += r.bytes > d.size() ? r.bytes - d.size() : d.size() - r.bytes;
+	return r;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"Usage: %s [options]\n"
+			"-c MHZ   PIO system clock (200)\n"
+			"-g NS    nSS inactive between bytes, 0 = held active (2000)\n"
+			"-d NS    data line delay after the falling SCK edge (0)\n"
+			"-y N     input synchronizer stages, 0 = bypassed (2)\n"
+			"-n N     bytes per SCK rate (4000)\n"
+			"-s SEED  random seed (1)\n",
+			name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const double sck_mhz[] = {1, 2, 4, 8, 10, 12.5, 16, 20, 25, 33.3, 40, 50};
+	double sys_mhz = 200;
+	double gap = 2000;
+	double skew = 0;
+	int sync = 2;
+	int n = 4000;
+	int seed = 1;
+	int c;
+	size_t i;
+	std::vector<uint8_t> data;
+	struct bus b;
+	struct result r;
+
+	while ((c = getopt(argc, argv, "c:g:d:y:n:s:h")) != -1) {
+		switch (c) {
+		case 'c': sys_mhz = atof(optarg); break;
+		case 'g': gap = atof(optarg); break;
+		case 'd': skew = atof(optarg); break;
+		case 'y': sync = atoi(optarg); break;
+		case 'n': n = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	/* Bit order first: single bits at both ends, then random bytes */
+	std::mt19937 rng(seed);
+	data = {0x80, 0x01, 0xF0, 0x0F, 0xAA, 0x55};
+	while ((int)data.size() < n)
+		data.push_back(rng());
+
+	printf("PIO %.1f MHz, %d sync stages, nSS %s, data delay %.1f ns\n", sys_mhz, sync,
+			gap ? "toggled" : "held", skew);
+	printf("  SCK MHz    bytes  errors  first error\n");
+	for (i = 0; i < sizeof(sck_mhz) / sizeof(sck_mhz[0]); i++) {
+		b.t_sck = 1000.0 / sck_mhz[i];
+		b.gap = gap ? (gap > 2 * b.t_sck ? gap : 2 * b.t_sck) : 0;
+		b.skew = skew;
+		b.data = &data;
+		r = run(&b, sys_mhz, sync);
+		printf("%9.1f %8u %7u", sck_mhz[i], r.bytes, r.errors);
+		if (r.first >= 0)
+			printf("  #%ld: %02x, got %02x", r.first, r.exp, r.got);
+		printf("\n");
+	}
+	return 0;
+}
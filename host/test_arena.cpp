@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "sysexq.h"
+
+/* Deterministic tests of sysex_arena: empty and full boundaries, wrap
+ * markers, grow across the arena end and loans held while the writer
+ * wraps. Producer and consumer take turns on one thread, so each case
+ * hits the same offsets every run. Exit status 1 on any failure.
+ */
+
+#define ARENA 512
+#define HDR sizeof(struct sysex_buffer)
+
+typedef sysex_arena<ARENA> arena;
+
+static int fails;
+
+#define CHECK(c) do { \
+	if (!(c)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #c); \
+		fails++; \
+	} \
+} while (0)
+
+/* F0 <tag> <tag + i>... F7 */
+static std::vector<uint8_t> frame(uint8_t tag, uint16_t len)
+{
+	std::vector<uint8_t> v(len);
+	uint16_t i;
+
+	v[0] = 0xF0;
+	for (i = 1; i < len - 1; i++)
+		v[i] = (tag + i) & 0x7F;
+	v[len - 1] = 0xF7;
+	return v;
+}
+
+/* Whole frame through claim, the framer and commit, false when there is no space */
+static bool push(arena &q, uint8_t tag, uint16_t len, bool pub = true)
+{
+	std::vector<uint8_t> v = frame(tag, len);
+	struct sysex_buffer *s = q.claim();
+
+	if (!s)
+		return false;
+	queue_append_chunk(q, s, v.data(), len);
+	if (!buf_full(s)) {
+		buf_clear(s);
+		return false;
+	}
+	q.commit();
+	if (pub)
+		q.publish();
+	return true;
+}
+
+static bool pop(arena &q, uint8_t tag, uint16_t len)
+{
+	std::vector<uint8_t> v = frame(tag, len);
+	struct sysex_buffer *s = q.front();
+	bool ok;
+
+	if (!s)
+		return false;
+	ok = s->len == len && std::vector<uint8_t>(s->buf, s->buf + s->len) == v;
+	buf_clear(s);
+	q.release();
+	return ok;
+}
+
+static void test_empty_full()
+{
+	static arena q;
+	uint8_t n = 0, i;
+
+	CHECK(!q.front());
+	CHECK(q.count() == 0);
+
+	/* Full: no claim, everything comes back in order */
+	while (push(q, n, 40))
+		n++;
+	CHECK(n > 0);
+	CHECK(q.count() <= ARENA);
+	CHECK(!q.claim());
+	for (i = 0; i < n; i++)
+		CHECK(pop(q, i, 40));
+	CHECK(!q.front());
+	CHECK(q.count() == 0);
+	CHECK(q.wr_index() == q.rd_index());
+
+	/* Full again after a wrap: a claim needs room for the minimal frame */
+	n = 0;
+	while (push(q, n, 40))
+		n++;
+	CHECK(n > 0);
+	for (i = 0; i < n && !q.claim(); i++)
+		CHECK(pop(q, i, 40));
+	CHECK(i <= (HDR + SYSEX_ARENA_MIN) / (HDR + 40) + 1);
+	CHECK(push(q, 100, 40));
+	for (; i < n; i++)
+		CHECK(pop(q, i, 40));
+	CHECK(pop(q, 100, 40));
+	CHECK(!q.front());
+}
+
+/* Claim of an untouched frame, then the wrap to the start */
+static void test_wrap_claimed()
+{
+	static arena q;
+	struct sysex_buffer *s, *t;
+	uint8_t n = 0, i;
+
+	while (push(q, n, 100))
+		n++;
+	/* The tail run is too short for the minimum, the head is still busy */
+	CHECK(!q.claim());
+
+	/* Claimed frames are not visible to the consumer before publish */
+	CHECK(pop(q, 0, 100));
+	CHECK(pop(q, 1, 100));
+	s = q.claim();
+	CHECK(s != nullptr);
+	t = q.claim();
+	CHECK(s == t);
+	CHECK(push(q, 200, 20, false));
+	for (i = 2; i < n; i++)
+		CHECK(pop(q, i, 100));
+	CHECK(!q.front());
+
+	/* The consumer skips the wrap marker after publish */
+	q.publish();
+	CHECK(q.wr_index() < q.rd_index());
+	CHECK(pop(q, 200, 20));
+	CHECK(!q.front());
+	CHECK(q.count() == 0);
+}
+
+/* A long frame started at the arena end is moved to the start */
+static void test_grow()
+{
+	static arena q;
+	std::vector<uint8_t> v = frame(7, 250);
+	struct sysex_buffer *s;
+	uint8_t n = 0, i;
+	uint16_t k;
+
+	/* Writer near the end, consumer behind it */
+	while (n < 2 && push(q, n, 130))
+		n++;
+	CHECK(n == 2);
+
+	/* The head is busy: no space to grow, the frame is dropped */
+	s = q.claim();
+	CHECK(s != nullptr);
+	k = queue_append_chunk(q, s, v.data(), v.size());
+	CHECK(k == v.size());
+	CHECK(!buf_full(s));
+
+	/* Consumer caught up: the frame moves to the start and keeps its bytes */
+	for (i = 0; i < n; i++)
+		CHECK(pop(q, i, 130));
+	buf_clear(s);
+	k = queue_append_chunk(q, s, v.data(), 150);
+	k += queue_append_chunk(q, s, v.data() + k, v.size() - k);
+	CHECK(k == v.size());
+	CHECK(buf_full(s));
+	q.commit();
+	q.publish();
+	CHECK(pop(q, 7, 250));
+	CHECK(!q.front());
+
+	/* Still usable after the move */
+	for (i = 0; i < 20; i++) {
+		CHECK(push(q, i, 90));
+		CHECK(pop(q, i, 90));
+	}
+}
+
+/* Loaned frames are headers only: the payload stays in the source arena
+ * until the loan is released, while both writers wrap many times.
+ */
+static void test_loans()
+{
+	static arena src, dst;
+	std::deque<std::vector<uint8_t> > held;
+	std::vector<uint8_t> v;
+	struct sysex_buffer *s, *l;
+	uint32_t i, done = 0;
+	uint8_t tag = 0;
+
+	for (i = 0; i < 3000; i++) {
+		/* Producer: frame into src, loaned to dst, up to 4 held */
+		v = frame(tag, 30 + i % 50);
+		s = held.size() < 4 ? src.claim() : nullptr;
+		if (s) {
+			queue_append_chunk(src, s, v.data(), v.size());
+			CHECK(buf_full(s));
+			src.commit();
+			src.publish();
+			l = dst.loan(s);
+			CHECK(l != nullptr);
+			dst.publish();
+			held.push_back(v);
+			tag++;
+			/* Header only, unless the wrapped tail counts too */
+			CHECK(dst.wr_index() < dst.rd_index() || dst.count() == held.size() * HDR);
+			continue;
+		}
+
+		/* Consumer: the loan is sent, then its source frame is released */
+		l = dst.front();
+		CHECK(l != nullptr && !held.empty());
+		if (!l || held.empty())
+			break;
+		CHECK(l->loans == 1);
+		CHECK(l->buf == src.front()->buf);
+		CHECK(std::vector<uint8_t>(l->buf, l->buf + l->len) == held.front());
+		dst.release();
+		buf_clear(src.front());
+		src.release();
+		held.pop_front();
+		done++;
+	}
+	CHECK(done > 1000);
+	CHECK(src.wr_index() < src.rd_index() || done > ARENA / HDR);
+	for (; !held.empty(); held.pop_front()) {
+		CHECK(dst.front() && src.front());
+		dst.release();
+		src.release();
+	}
+	CHECK(!dst.front() && !src.front());
+}
+
+int main()
+{
+	test_empty_full();
+	test_wrap_claimed();
+	test_grow();
+	test_loans();
+	printf("%d failures\n", fails);
+	return fails ? 1 : 0;
+}
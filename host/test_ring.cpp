@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "ring.h"
+
+/* Stress test of spsc_ring with the producer and the consumer on two threads:
+ * the producer commits runs of sequence numbers and publishes each run at
+ * once, the consumer checks that every number arrives once and in order.
+ * Exit status 1 on the first error.
+ */
+
+#define TEST_ITEMS 20000000u
+
+struct item {
+	uint32_t seq;
+	uint32_t check;         // ~seq, catches a slot read before it was written
+};
+
+template <unsigned N>
+static int run(uint32_t items, uint32_t batch)
+{
+	static spsc_ring<struct item, N> q;
+	std::atomic<uint32_t> bad(0);
+	uint32_t seq = 0;
+	uint32_t k = 0;
+	struct item *s;
+
+	std::thread consumer([&] {
+		uint32_t next = 0;
+		struct item *c;
+
+		while (next < items) {
+			c = q.front();
+			if (!c) {
+				std::this_thread::yield();
+				continue;
+			}
+			if (c->seq != next || c->check != ~next) {
+				if (!bad.load())
+					fprintf(stderr, "N %u batch %u: got %u/%08x, expected %u\n",
+							N, batch, c->seq, c->check, next);
+				bad++;
+				next = c->seq;
+			}
+			c->seq = c->check = 0;
+			q.release();
+			next++;
+		}
+	});
+
+	while (seq < items) {
+		s = q.claim();
+		if (!s) {
+			/* Full: what is committed has to go out */
+			q.publish();
+			std::this_thread::yield();
+			continue;
+		}
+		s->seq = seq;
+		s->check = ~seq;
+		q.commit();
+		seq++;
+		if (++k == batch || seq == items) {
+			q.publish();
+			k = 0;
+		}
+	}
+	consumer.join();
+
+	if (q.front() || q.count()) {
+		fprintf(stderr, "N %u batch %u: not empty at the end\n", N, batch);
+		bad++;
+	}
+	printf("N %-3u batch %-3u %u items, %u errors\n", N, batch, items, bad.load());
+	return bad.load() ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t items = argc > 1 ? strtoul(argv[1], nullptr, 0) : TEST_ITEMS;
+	int ret = 0;
+
+	ret |= run<2>(items, 1);
+	ret |= run<8>(items, 1);
+	ret |= run<8>(items, 3);
+	ret |= run<8>(items, 8);
+	ret |= run<64>(items, 17);
+	return ret;
+}
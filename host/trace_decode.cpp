@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <cstdint>
+
+#include "trace.h"
+
+/* Render the binary trace stream of the bridge (console command t)
+ * Usage: trace_decode [FILE], reads stdin without FILE
+ */
+
+static const char *names[] = {"???", "F2M", "M2F", "U2M", "M2U", "ERR", "DROP", "RAW", "PIN"};
+
+int main(int argc, char *argv[])
+{
+	int c;
+	uint8_t hdr[TRACE_HDR];
+	uint8_t data[0x10000];
+	uint16_t len;
+	uint32_t i;
+	uint32_t ts;
+	uint32_t skipped = 0;
+	FILE *f = stdin;
+
+	if (argc > 1) {
+		f = fopen(argv[1], "rb");
+		if (!f) {
+			perror(argv[1]);
+			return 1;
+		}
+	}
+
+	while ((c = fgetc(f)) != EOF) {
+		/* Text output of the console can be interleaved */
+		if (c != TRACE_MAGIC) {
+			skipped++;
+			continue;
+		}
+		hdr[0] = c;
+		if (fread(hdr + 1, 1, TRACE_HDR - 1, f) != TRACE_HDR - 1)
+			break;
+		len = hdr[2] | hdr[3] << 8;
+		ts = hdr[4] | hdr[5] << 8 | hdr[6] << 16 | (uint32_t)hdr[7] << 24;
+		if (fread(data, 1, len, f) != len)
+			break;
+
+		printf("%6lu.%06lu %-4s %4u:", (unsigned long)(ts / 1000000), (unsigned long)(ts % 1000000),
+				hdr[1] <= TRACE_PIN ? names[hdr[1]] : names[0], len);
+
+		if (hdr[1] == TRACE_ERR && len == 2) {
+			printf(" %04x", data[0] | data[1] << 8);
+		} else if (hdr[1] == TRACE_PIN && len == 2) {
+			printf(" nIRQ1 %d nIRQB %d mux %02x", !!(data[0] & TRACE_PIN_NIRQ1),
+					!!(data[0] & TRACE_PIN_NIRQB), data[1]);
+		} else if (hdr[1] == TRACE_RAW && len % 2 == 0) {
+			printf(" SPI0");
+			for (i = 0; i < len / 2u; i++)
+				printf(" %02x", data[i]);
+			printf(" | SPI1");
+			for (; i < len; i++)
+				printf(" %02x", data[i]);
+		} else if (hdr[1] == TRACE_DROP && len == 4) {
+			printf(" %lu records", (unsigned long)(data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24));
+		} else {
+			for (i = 0; i < len; i++)
+				printf(" %02x", data[i]);
+		}
+		putchar('\n');
+	}
+
+	if (skipped)
+		fprintf(stderr, "Skipped %lu bytes outside of records\n", (unsigned long)skipped);
+	return 0;
+}
@@ -0,0 +1,149 @@
+#include <cstring>
+
+#include "hal.h"
+#include "ijsched.h"
+
+static void bit_set(uint8_t *map, uint8_t cmd, bool en)
+{
+	cmd &= 0x7F;
+	if (en)
+		map[cmd >> 3] |= 1 << (cmd & 7);
+	else
+		map[cmd >> 3] &= ~(1 << (cmd & 7));
+}
+
+static bool HAL_RAM_FUNC(bit_get)(const uint8_t *map, const struct sysex_buffer *req)
+{
+	uint8_t cmd = req->buf[1] & 0x7F;
+	return map[cmd >> 3] & (1 << (cmd & 7));
+}
+
+void sched_init(struct ij_sched *q)
+{
+	uint8_t i;
+
+	memset(q, 0, sizeof(*q));
+	for (i = 0; i < SCHED_SLOTS; i++) {
+		q->s[i].req.buf = q->s[i].data;
+		q->s[i].req.size = SCHED_REQ_MAX;
+	}
+
+	/* Parameter write: F0 10 <ch> <param> <value> F7 */
+	sched_set_coalesce(q, 0x10, true);
+	/* Status request */
+	sched_set_background(q, 0x38, true);
+}
+
+void sched_set_coalesce(struct ij_sched *q, uint8_t cmd, bool en)
+{
+	bit_set(q->coalesce, cmd, en);
+}
+
+void sched_set_background(struct ij_sched *q, uint8_t cmd, bool en)
+{
+	bit_set(q->background, cmd, en);
+}
+
+/* Pending write to the same parameter */
+static struct sched_slot *HAL_RAM_FUNC(sched_find)(struct ij_sched *q, const struct sysex_buffer *req, bool uncached)
+{
+	uint8_t i;
+	struct sched_slot *s;
+
+	if (req->len < 4 || !bit_get(q->coalesce, req))
+		return nullptr;
+
+	for (i = 0; i < SCHED_SLOTS; i++) {
+		s = &q->s[i];
+		if (s->used && !s->busy && s->uncached == uncached && s->req.clients == req->clients &&
+				s->req.len == req->len &&
+				memcmp(s->req.buf, req->buf, req->len - 2) == 0)
+			return s;
+	}
+	return nullptr;
+}
+
+/* Take over the request: 0, RET_ERR_BUF_FULL or RET_ERR_BUF_OVERFLOW */
+int HAL_RAM_FUNC(sched_put)(struct ij_sched *q, const struct sysex_buffer *req, bool uncached)
+{
+	uint8_t i;
+	struct sched_slot *s;
+
+	if (req->len > SCHED_REQ_MAX)
+		return RET_ERR_BUF_OVERFLOW;
+
+	s = sched_find(q, req, uncached);
+	if (s) {
+		/* Latest wins: the value byte is the only difference */
+		s->req.buf[req->len - 2] = req->buf[req->len - 2];
+		s->dups++;
+		q->coalesced++;
+		return 0;
+	}
+
+	for (i = 0; i < SCHED_SLOTS && q->s[i].used; i++);
+	if (i == SCHED_SLOTS)
+		return RET_ERR_BUF_FULL;
+
+	s = &q->s[i];
+	memcpy(s->req.buf, req->buf, req->len);
+	s->req.len = req->len;
+	s->req.pos = req->len;
+	s->req.ts = req->ts;
+	s->req.clients = req->clients;
+	s->used = true;
+	s->busy = false;
+	s->uncached = uncached;
+	s->aged = false;
+	s->dups = 0;
+	s->seq = q->seq++;
+	return 0;
+}
+
+/* Oldest interactive request, then the oldest background one */
+struct sched_slot *HAL_RAM_FUNC(sched_next)(struct ij_sched *q, uint32_t now)
+{
+	uint8_t i;
+	bool bg, best_bg = true;
+	struct sched_slot *s, *best = nullptr;
+
+	for (i = 0; i < SCHED_SLOTS; i++) {
+		s = &q->s[i];
+		if (!s->used || s->busy)
+			continue;
+		bg = bit_get(q->background, &s->req) && now - s->req.ts < SCHED_AGE_US;
+		if (!best || bg < best_bg || (bg == best_bg && (int32_t)(s->seq - best->seq) < 0)) {
+			best = s;
+			best_bg = bg;
+		}
+	}
+
+	if (best) {
+		/* Picked again after ij_unpick: counted once */
+		if (!best_bg && !best->aged && bit_get(q->background, &best->req)) {
+			best->aged = true;
+			q->aged++;
+		}
+		best->busy = true;
+	}
+	return best;
+}
+
+void HAL_RAM_FUNC(sched_done)(struct ij_sched *q, struct sched_slot *s)
+{
+	buf_clear(&s->req);
+	s->used = false;
+	s->busy = false;
+}
+
+/* Any request other than the background ones is pending or being injected */
+bool HAL_RAM_FUNC(sched_foreground)(const struct ij_sched *q)
+{
+	uint8_t i;
+
+	for (i = 0; i < SCHED_SLOTS; i++) {
+		if (q->s[i].used && !bit_get(q->background, &q->s[i].req))
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,51 @@
+#ifndef _IJSCHED_H_
+#define _IJSCHED_H_
+
+#include <cstdint>
+
+#include "sysex.h"
+
+/* Pending inject requests, taken over from buf_ijreq by core1.
+ *
+ * Requests with a command byte marked as coalescable are parameter writes:
+ * the parameter is everything but the last data byte (the value), a pending
+ * write to the same parameter from the same client is replaced by the newer
+ * one. The response of the newest write answers the replaced ones too.
+ * Requests with a command byte marked as background (status polls) are
+ * served after all other requests, unless they are waiting longer than
+ * SCHED_AGE_US. Requests of the same class go out in the arrival order.
+ */
+
+#define SCHED_SLOTS 8
+#define SCHED_REQ_MAX 512               // longest request taken over
+#define SCHED_AGE_US 20000
+
+struct sched_slot {
+	uint8_t data[SCHED_REQ_MAX];
+	struct sysex_buffer req;
+	bool used;
+	bool busy;                      // being injected, no more coalescing
+	bool uncached;                  // bypasses the response cache
+	bool aged;                      // background request counted in aged
+	uint16_t dups;                  // replaced requests answered with this one
+	uint32_t seq;                   // arrival order, req.ts is kept from the oldest
+};
+
+struct ij_sched {
+	struct sched_slot s[SCHED_SLOTS];
+	uint8_t coalesce[16];           // bitmap of coalescable command bytes
+	uint8_t background[16];         // bitmap of background command bytes
+	uint32_t seq;
+	uint32_t coalesced;
+	uint32_t aged;                  // background requests served as interactive
+};
+
+void sched_init(struct ij_sched *q);
+void sched_set_coalesce(struct ij_sched *q, uint8_t cmd, bool en);
+void sched_set_background(struct ij_sched *q, uint8_t cmd, bool en);
+int sched_put(struct ij_sched *q, const struct sysex_buffer *req, bool uncached);
+struct sched_slot *sched_next(struct ij_sched *q, uint32_t now);
+void sched_done(struct ij_sched *q, struct sched_slot *s);
+bool sched_foreground(const struct ij_sched *q);
+
+#endif
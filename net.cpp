@@ -0,0 +1,80 @@
+#include <cstring>
+
+#include "net.h"
+
+void net_tx_begin(struct net_tx *t, uint8_t *buf, uint16_t size, uint16_t seq)
+{
+	t->buf = buf;
+	t->size = size;
+	t->buf[0] = NET_MAGIC;
+	t->buf[1] = NET_VER;
+	t->buf[2] = seq;
+	t->buf[3] = seq >> 8;
+	t->len = NET_HDR;
+	t->frames = 0;
+}
+
+/* Returns false when the frame does not fit, the datagram stays unchanged */
+bool net_tx_put(struct net_tx *t, const uint8_t *msg, uint16_t len, uint16_t tag)
+{
+	if (t->size - t->len < NET_FRAME_HDR + len)
+		return false;
+	t->buf[t->len++] = len;
+	t->buf[t->len++] = len >> 8;
+	t->buf[t->len++] = tag;
+	t->buf[t->len++] = tag >> 8;
+	memcpy(t->buf + t->len, msg, len);
+	t->len += len;
+	t->frames++;
+	return true;
+}
+
+bool net_rx_begin(struct net_rx *r, const uint8_t *buf, uint16_t len, uint16_t *seq)
+{
+	if (len < NET_HDR || buf[0] != NET_MAGIC || buf[1] != NET_VER)
+		return false;
+	*seq = buf[2] | buf[3] << 8;
+	r->p = buf + NET_HDR;
+	r->end = buf + len;
+	return true;
+}
+
+/* Returns false at the end or at a truncated frame */
+bool net_rx_next(struct net_rx *r, const uint8_t **msg, uint16_t *len, uint16_t *tag)
+{
+	uint16_t n;
+
+	if (r->end - r->p < NET_FRAME_HDR)
+		return false;
+	n = r->p[0] | r->p[1] << 8;
+	if (r->end - r->p - NET_FRAME_HDR < n) {
+		r->p = r->end;
+		return false;
+	}
+	*msg = r->p + NET_FRAME_HDR;
+	*len = n;
+	*tag = r->p[2] | r->p[3] << 8;
+	r->p += NET_FRAME_HDR + n;
+	return true;
+}
+
+void net_seq_init(struct net_seq *s)
+{
+	memset(s, 0, sizeof(*s));
+}
+
+/* Returns true when the datagram is to be processed */
+bool net_seq_check(struct net_seq *s, uint16_t seq)
+{
+	int16_t d = seq - s->next;
+
+	if (s->valid && d < 0 && d > -NET_SEQ_WINDOW) {
+		s->dropped++;
+		return false;
+	}
+	if (s->valid && d > 0)
+		s->lost += d;
+	s->valid = true;
+	s->next = seq + 1;
+	return true;
+}
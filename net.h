@@ -0,0 +1,53 @@
+#ifndef _NET_H_
+#define _NET_H_
+
+#include <cstdint>
+
+/* UDP control transport: a datagram carries one or more SysEx frames
+ *
+ * NET_MAGIC NET_VER <seq LE16> (<len LE16> <tag LE16> F0 .. F7)...
+ *
+ * Each side numbers its datagrams, the receiver drops duplicates and
+ * late datagrams and counts the lost ones. The bridge answers to the
+ * peer of the last request. The tag of a frame from the bridge holds
+ * its stream and seq (FRAME_TAG), requests may leave it 0.
+ */
+
+#define NET_PORT 1602
+#define NET_MAGIC 0x53                  // 'S'
+#define NET_VER 2
+#define NET_HDR 4
+#define NET_FRAME_HDR 4
+#define NET_DGRAM_MAX 1024              // below the Ethernet MTU, no IP fragments
+#define NET_SEQ_WINDOW 1024             // seq further back means a restarted peer
+
+struct net_tx {
+	uint8_t *buf;
+	uint16_t size;
+	uint16_t len;
+	uint16_t frames;
+};
+
+struct net_rx {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+struct net_seq {
+	uint16_t next;
+	bool valid;
+	uint32_t lost;
+	uint32_t dropped;               // duplicate or late
+};
+
+void net_tx_begin(struct net_tx *t, uint8_t *buf, uint16_t size, uint16_t seq);
+bool net_tx_put(struct net_tx *t, const uint8_t *msg, uint16_t len, uint16_t tag);
+
+/* Returns false for a malformed datagram, seq is valid otherwise */
+bool net_rx_begin(struct net_rx *r, const uint8_t *buf, uint16_t len, uint16_t *seq);
+bool net_rx_next(struct net_rx *r, const uint8_t **msg, uint16_t *len, uint16_t *tag);
+
+void net_seq_init(struct net_seq *s);
+bool net_seq_check(struct net_seq *s, uint16_t seq);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <atomic>
+#include <cstdint>
+
+/* Lock-free single producer / single consumer ring of N slots.
+ *
+ * Producer: claim() the slot being filled (returns the same slot until it
+ * is committed), commit() it, publish() all committed slots at once.
+ * Consumer: front() the oldest published slot, release() it when done.
+ *
+ * The counters are free running, N must be a power of two.
+ */
+template <typename T, unsigned N>
+class spsc_ring {
+	static_assert(N > 0 && (N & (N - 1)) == 0, "ring depth must be a power of two");
+
+public:
+	T slot[N];
+
+	spsc_ring() : wr(0), rd(0), wr_priv(0) {}
+
+	/* Producer side */
+	T *claim()
+	{
+		if (wr_priv - rd.load(std::memory_order_acquire) >= N)
+			return nullptr;
+		return &slot[wr_priv & (N - 1)];
+	}
+
+	void commit()
+	{
+		wr_priv++;
+	}
+
+	void publish()
+	{
+		wr.store(wr_priv, std::memory_order_release);
+	}
+
+	/* Consumer side */
+	T *front()
+	{
+		uint32_t r = rd.load(std::memory_order_relaxed);
+
+		if (wr.load(std::memory_order_acquire) == r)
+			return nullptr;
+		return &slot[r & (N - 1)];
+	}
+
+	void release()
+	{
+		rd.store(rd.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	uint32_t wr_index() const { return wr.load(std::memory_order_relaxed); }
+	uint32_t rd_index() const { return rd.load(std::memory_order_relaxed); }
+	uint32_t count() const { return wr_index() - rd_index(); }
+	static constexpr unsigned depth() { return N; }
+
+private:
+	std::atomic<uint32_t> wr;
+	std::atomic<uint32_t> rd;
+	uint32_t wr_priv;       // producer only: committed, not yet published
+};
+
+#endif
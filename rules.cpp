@@ -0,0 +1,198 @@
+#include <cstring>
+
+#include "hal.h"
+#include "rules.h"
+
+static void rule_set(struct rule *r, uint8_t dirs, uint8_t act, uint8_t cmd, uint8_t sub, uint16_t len)
+{
+	memset(r, 0, sizeof(*r));
+	r->dirs = dirs;
+	r->act = act;
+	r->len_min = len;
+	r->len_max = len;
+	r->val[0] = cmd;
+	r->mask[0] = 0x7F;
+	r->val[1] = sub;
+	r->mask[1] = 0x7F;
+}
+
+/* Default rules, host rules and the rest of the table stay */
+void rules_preset(struct rule_table *t, uint8_t presets)
+{
+	uint8_t req = presets & RULES_FILTER_REQUEST ? RULE_DROP : RULE_ROUTE | RULE_LOG;
+	struct rule p[RULES_PRESET];
+	struct rule *r = p;
+	uint8_t i;
+
+	memset(p, 0, sizeof(p));
+
+	/* Status request: F0 38 03 F7 */
+	rule_set(r, RULE_REQ, req, 0x38, 0x03, 4);
+	if (presets & RULES_FILTER_STATUS)
+		r->act &= ~RULE_LOG;
+	r++;
+
+	/* Status response: F0 39 03 <payload> F7 */
+	rule_set(r, RULE_RES, RULE_ROUTE | RULE_LOG, 0x39, 0x03, BUF_STATUS_LEN);
+	if (presets & RULES_FILTER_STATUS)
+		r->act = RULE_ROUTE | RULE_LOG_NEW;
+	r++;
+
+	/* Any other request */
+	if (presets & RULES_FILTER_REQUEST) {
+		r->dirs = RULE_REQ;
+		r->act = RULE_DROP;
+	}
+
+	for (i = 0; i < RULES_PRESET; i++) {
+		if (!(t->host & (1 << i)))
+			t->r[i] = p[i];
+	}
+	rules_compile(t);
+}
+
+void rules_init(struct rule_table *t, uint8_t presets)
+{
+	memset(t, 0, sizeof(*t));
+	rules_preset(t, presets);
+}
+
+/* F0 7D 40 <idx> <dirs> <act> <min lo> <min hi> <max lo> <max hi> (<val> <mask>)... F7
+ * sets the rule, F0 7D 40 <idx> F7 removes it. Lengths are in 7-bit groups, LSB first.
+ */
+bool rules_load(struct rule_table *t, const struct sysex_buffer *s)
+{
+	struct rule *r;
+	uint8_t i, n;
+	const uint8_t *p = s->buf + 3;
+
+	if (s->len < 5 || p[0] >= RULES_MAX)
+		return false;
+	r = &t->r[p[0]];
+
+	if (s->len == 5) {
+		memset(r, 0, sizeof(*r));
+		t->host |= 1 << p[0];
+		rules_compile(t);
+		return true;
+	}
+
+	/* Checked before narrowing: raw and UDP frames are longer than 255 */
+	if (s->len < 11 || s->len > 11 + 2 * RULE_HDR || (s->len - 11) % 2)
+		return false;
+	n = s->len - 11;
+
+	memset(r, 0, sizeof(*r));
+	r->dirs = p[1] & (RULE_REQ | RULE_RES);
+	r->act = p[2];
+	r->len_min = p[3] | p[4] << 7;
+	r->len_max = p[5] | p[6] << 7;
+	for (i = 0; i < n / 2; i++) {
+		r->val[i] = p[7 + 2 * i];
+		r->mask[i] = p[8 + 2 * i];
+	}
+	t->host |= 1 << p[0];
+	rules_compile(t);
+	return true;
+}
+
+void rules_compile(struct rule_table *t)
+{
+	uint8_t i, d, b;
+	const struct rule *r;
+
+	memset(t->cand, 0, sizeof(t->cand));
+	t->cache = 0;
+	for (i = 0; i < RULES_MAX; i++) {
+		r = &t->r[i];
+		if (r->dirs & RULE_REQ && r->act & RULE_CACHE)
+			t->cache |= 1 << i;
+		for (d = 0; d < 2; d++) {
+			if (!(r->dirs & (1 << d)))
+				continue;
+			for (b = 0; b < 128; b++) {
+				if ((b & r->mask[0]) == (r->val[0] & r->mask[0]))
+					t->cand[d][b] |= 1 << i;
+			}
+		}
+	}
+}
+
+static bool HAL_RAM_FUNC(rule_match)(const struct rule *r, const struct sysex_buffer *s)
+{
+	uint8_t i;
+
+	if (s->len < r->len_min || (r->len_max && s->len > r->len_max))
+		return false;
+	for (i = 1; i < RULE_HDR; i++) {
+		if (!r->mask[i])
+			continue;
+		if (s->len < i + 2 || (s->buf[i + 1] & r->mask[i]) != (r->val[i] & r->mask[i]))
+			return false;
+	}
+	return true;
+}
+
+/* First matching rule of the set, -1: none */
+static int8_t HAL_RAM_FUNC(rules_first)(const struct rule_table *t, uint16_t m, const struct sysex_buffer *s)
+{
+	uint8_t i;
+
+	while (m) {
+		i = __builtin_ctz(m);
+		if (rule_match(&t->r[i], s))
+			return i;
+		m &= m - 1;
+	}
+	return -1;
+}
+
+/* First matching rule, -1: none */
+int8_t HAL_RAM_FUNC(rules_find)(const struct rule_table *t, uint8_t dir, const struct sysex_buffer *s)
+{
+	if (s->len < 2)
+		return -1;
+	return rules_first(t, t->cand[dir == RULE_RES][s->buf[1] & 0x7F], s);
+}
+
+static uint32_t HAL_RAM_FUNC(frame_hash)(const struct sysex_buffer *s)
+{
+	uint32_t h = 2166136261u;
+	int16_t i;
+
+	for (i = 0; i < s->len; i++)
+		h = (h ^ s->buf[i]) * 16777619u;
+	return h;
+}
+
+/* Actions for the completed frame, RULE_LOG_NEW resolved to RULE_LOG */
+uint8_t HAL_RAM_FUNC(rules_apply)(struct rule_table *t, uint8_t dir, const struct sysex_buffer *s)
+{
+	int8_t i = rules_find(t, dir, s);
+	struct rule *r;
+	uint8_t act;
+	uint32_t h;
+
+	if (i < 0)
+		return RULE_ROUTE | RULE_LOG;
+
+	r = &t->r[i];
+	act = r->act & ~RULE_LOG_NEW;
+	if (r->act & RULE_LOG_NEW) {
+		h = frame_hash(s);
+		if (h != r->last)
+			act |= RULE_LOG;
+		r->last = h;
+	}
+	return act;
+}
+
+/* The status request, or any matching rule with RULE_CACHE */
+bool HAL_RAM_FUNC(rules_cacheable)(const struct rule_table *t, const struct sysex_buffer *req)
+{
+	if (is_status_req(req))
+		return true;
+	if (req->len < 2)
+		return false;
+	return rules_first(t, t->cand[0][req->buf[1] & 0x7F] & t->cache, req) >= 0;
+}
@@ -0,0 +1,73 @@
+#ifndef _RULES_H_
+#define _RULES_H_
+
+#include <cstdint>
+
+#include "sysex.h"
+
+/* Rule table for the intercepted frames, evaluated by core1 when the
+ * transaction completes.
+ *
+ * A rule matches the frames of one or both directions by the header bytes
+ * after F0 (value and mask) and by the frame length. The first matching
+ * rule gives the actions; a frame without any matching rule is routed and
+ * logged. Frames neither logged nor loaned are not queued to core0 at all.
+ *
+ * The rules are compiled into a table indexed by the byte after F0: the
+ * candidate rules for each value, so only those are checked at run time.
+ *
+ * Cacheability does not depend on the first match: a request is cacheable
+ * (no side effects on the mixer state) when it is the status request or
+ * when any matching rule has RULE_CACHE, so a drop or log rule does not
+ * change it. Any other request drops the whole response cache. The same
+ * classification applies to the injected requests.
+ *
+ * The presets fill the first RULES_PRESET rules, except those loaded by
+ * the host: the console switches them without touching the host rules.
+ */
+
+#define RULES_MAX 16
+#define RULE_HDR 4              // header bytes matched, after F0
+#define RULES_PRESET 3          // rules of the default table
+
+/* Directions */
+#define RULE_REQ (1 << 0)       // DSPB request (ic1)
+#define RULE_RES (1 << 1)       // CPB response (ic0)
+
+/* Actions */
+#define RULE_DROP 0
+#define RULE_ROUTE (1 << 0)     // to the clients monitoring the interception
+#define RULE_LOG (1 << 1)       // echo on the console (or the binary trace)
+#define RULE_LOG_NEW (1 << 2)   // log only when it differs from the last frame of the rule
+#define RULE_CACHE (1 << 3)     // cacheable request
+
+/* Presets of the default table */
+#define RULES_FILTER_STATUS (1 << 0)    // status polls not logged, unchanged status not logged
+#define RULES_FILTER_REQUEST (1 << 1)   // DSPB requests neither routed nor logged
+
+struct rule {
+	uint8_t dirs;                   // RULE_REQ, RULE_RES; 0: unused
+	uint8_t act;
+	uint16_t len_min;
+	uint16_t len_max;               // 0: any
+	uint8_t val[RULE_HDR];
+	uint8_t mask[RULE_HDR];
+	uint32_t last;                  // RULE_LOG_NEW: hash of the last frame
+};
+
+struct rule_table {
+	struct rule r[RULES_MAX];
+	uint16_t cand[2][128];          // compiled: rules matching the byte after F0, per direction
+	uint16_t cache;                 // compiled: rules with RULE_CACHE
+	uint16_t host;                  // rules set or removed by the host
+};
+
+void rules_init(struct rule_table *t, uint8_t presets);
+void rules_preset(struct rule_table *t, uint8_t presets);
+bool rules_load(struct rule_table *t, const struct sysex_buffer *s);
+void rules_compile(struct rule_table *t);
+int8_t rules_find(const struct rule_table *t, uint8_t dir, const struct sysex_buffer *s);
+uint8_t rules_apply(struct rule_table *t, uint8_t dir, const struct sysex_buffer *s);
+bool rules_cacheable(const struct rule_table *t, const struct sysex_buffer *req);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <cstring>
+
+#include "hal.h"
+#include "stats.h"
+
+void HAL_RAM_FUNC(hist_add)(struct hist *h, uint32_t v)
+{
+	uint8_t i = 0;
+
+	while (i < HIST_BUCKETS - 1 && (v >> i))
+		i++;
+	h->b[i]++;
+	h->n++;
+	h->sum += v;
+	if (v > h->max)
+		h->max = v;
+}
+
+void hist_clear(struct hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void hist_print(const char *name, const struct hist *h)
+{
+	uint8_t i;
+
+	printf("%-9s n %lu avg %lu max %lu us:", name, (unsigned long)h->n,
+			(unsigned long)(h->n ? h->sum / h->n : 0), (unsigned long)h->max);
+	for (i = 0; i < HIST_BUCKETS; i++)
+		printf(" %lu", (unsigned long)h->b[i]);
+	putchar('\n');
+}
+
+/* Fields written by the core */
+void stats_clear(struct bridge_stats *s, uint8_t core)
+{
+	if (core == 0) {
+		s->hwm_ijreq = 0;
+	} else {
+		hist_clear(&s->tr);
+		hist_clear(&s->tr_drain);
+		hist_clear(&s->tr_push);
+		hist_clear(&s->tr_wait);
+		hist_clear(&s->ij);
+		hist_clear(&s->ic);
+		hist_clear(&s->loop);
+		s->hwm_cap = 0;
+		s->hwm_ic = 0;
+		s->hwm_ijres = 0;
+		memset(s->lost, 0, sizeof(s->lost));
+	}
+	s->idle[core] = 0;
+	memset(s->err[core], 0, sizeof(s->err[core]));
+}
+
+void stats_print(const struct bridge_stats *s)
+{
+	uint8_t i;
+
+	printf("Latency histograms, buckets <1, <2, <4, ... us\n");
+	hist_print("TR", &s->tr);
+	hist_print("TR drain", &s->tr_drain);
+	hist_print("TR push", &s->tr_push);
+	hist_print("TR wait", &s->tr_wait);
+	hist_print("IJ", &s->ij);
+	hist_print("IC", &s->ic);
+	if (s->loop.n)
+		hist_print("Loop", &s->loop);
+	printf("High-water (CAP, IC, IJREQ, IJRES): %lu %lu %lu %lu\n",
+			(unsigned long)s->hwm_cap, (unsigned long)s->hwm_ic,
+			(unsigned long)s->hwm_ijreq, (unsigned long)s->hwm_ijres);
+	printf("Lost frames (responses, deltas, intercepted): %lu %lu %lu\n",
+			(unsigned long)s->lost[STREAM_RES], (unsigned long)s->lost[STREAM_DELTA],
+			(unsigned long)s->lost[STREAM_MON]);
+	printf("Idle (core0, core1): %lu %lu ms\n",
+			(unsigned long)(s->idle[0] / 1000), (unsigned long)(s->idle[1] / 1000));
+	printf("Error counts:");
+	for (i = 0; i < STATS_ERRS; i++) {
+		if (s->err[0][i] + s->err[1][i])
+			printf(" %d:%lu", i, (unsigned long)(s->err[0][i] + s->err[1][i]));
+	}
+	putchar('\n');
+}
@@ -0,0 +1,62 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <cstdint>
+
+#include "sysex.h"
+
+/* Runtime statistics of the bridge: latency histograms, queue high-water
+ * marks and error counters. Printed by the console command l, cleared by L.
+ * Each core clears only its own fields: stats_clear(s, 0) on core0,
+ * stats_clear(s, 1) on core1.
+ *
+ * The Cortex-M0+ has no cycle counter, the latencies are in us of the
+ * system timer. Histogram bucket i counts values in [2^(i-1), 2^i).
+ */
+
+#define HIST_BUCKETS 16
+#define STATS_ERRS 16
+
+struct hist {
+	uint32_t b[HIST_BUCKETS];
+	uint32_t n;
+	uint32_t max;
+	uint64_t sum;
+};
+
+struct bridge_stats {
+	/* core1 */
+	struct hist tr;                 // transceive_request
+	struct hist tr_drain;           // FIFO drain before the request
+	struct hist tr_push;            // request push
+	struct hist tr_wait;            // response
+	struct hist ij;                 // injected request from USB-MIDI queued until answered
+	struct hist ic;                 // routing of a completed interception
+	struct hist loop;               // core1 loop iteration (RT_EN)
+	uint32_t hwm_cap;               // capture ring occupancy (bytes)
+	uint32_t hwm_ic;                // interception queue (bytes or frames)
+	uint32_t hwm_ijres;
+	uint32_t lost[STREAMS];         // frames lost for lack of space in buf_ijres, each client counts
+
+	/* core0 */
+	uint32_t hwm_ijreq;
+
+	/* each core */
+	uint64_t idle[2];               // time asleep in hal_wait (us), core0 and core1
+	uint32_t err[2][STATS_ERRS];    // count of each ERR_ bit, core0 and core1
+};
+
+void hist_add(struct hist *h, uint32_t v);
+void hist_clear(struct hist *h);
+void hist_print(const char *name, const struct hist *h);
+
+void stats_clear(struct bridge_stats *s, uint8_t core);
+void stats_print(const struct bridge_stats *s);
+
+static inline void hwm_update(uint32_t *hwm, uint32_t v)
+{
+	if (v > *hwm)
+		*hwm = v;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "hal.h"
+#include "status.h"
+
+void status_init(struct status_model *m)
+{
+	uint8_t c;
+
+	for (c = 0; c < CLIENTS; c++)
+		m->sub[c] = 0;
+	m->snap = 0;
+	m->valid = false;
+}
+
+/* Take a status response, return the mask of changed fields.
+ * Everything is changed after init.
+ */
+uint64_t HAL_RAM_FUNC(status_update)(struct status_model *m, const struct sysex_buffer *s)
+{
+	uint8_t i;
+	uint8_t c;
+	uint64_t changed = 0;
+
+	for (i = 0; i < STATUS_FIELDS; i++) {
+		c = s->buf[STATUS_HDR + i];
+		if (!m->valid || m->field[i] != c)
+			changed |= 1ull << i;
+		m->field[i] = c;
+	}
+	m->valid = true;
+	return changed;
+}
+
+/* Encode fields of the mask as a delta message, return its length */
+int16_t HAL_RAM_FUNC(status_delta)(const struct status_model *m, uint64_t mask, uint8_t *buf, int16_t size)
+{
+	uint8_t i;
+	int16_t len = 0;
+
+	if (size < STATUS_DELTA_MAX)
+		return 0;
+
+	buf[len++] = 0xF0;
+	buf[len++] = BRIDGE_SYSEX_ID;
+	buf[len++] = BRIDGE_CMD_DELTA;
+	for (i = 0; i < STATUS_FIELDS; i++) {
+		if (!(mask & (1ull << i)))
+			continue;
+		buf[len++] = i;
+		buf[len++] = m->field[i] & 0x7F;
+	}
+	buf[len++] = 0xF7;
+	return len;
+}
+
+/* F0 7D 11 <mask in 7-bit groups, LSB first> F7 */
+bool status_subscribe(struct status_model *m, uint8_t client, const struct sysex_buffer *s)
+{
+	int16_t i;
+	uint64_t sub = 0;
+
+	if (s->len < 5)
+		return false;
+
+	for (i = 3; i < s->len - 1 && (i - 3) * 7 < STATUS_FIELDS; i++)
+		sub |= (uint64_t)(s->buf[i] & 0x7F) << ((i - 3) * 7);
+
+	m->sub[client] = sub & ((1ull << STATUS_FIELDS) - 1);
+	m->snap |= CLIENT_BIT(client);
+	return true;
+}
+
+/* Fields of the update to send to the client, all of them after a new
+ * subscription or a snapshot request
+ */
+uint64_t HAL_RAM_FUNC(status_client_mask)(struct status_model *m, uint8_t client, uint64_t changed)
+{
+	if (m->snap & CLIENT_BIT(client)) {
+		m->snap &= ~CLIENT_BIT(client);
+		return m->sub[client];
+	}
+	return changed & m->sub[client];
+}
+
+/* CLIENT_BIT mask of the subscribed clients */
+uint8_t status_subscribers(const struct status_model *m)
+{
+	uint8_t c, mask = 0;
+
+	for (c = 0; c < CLIENTS; c++) {
+		if (m->sub[c])
+			mask |= CLIENT_BIT(c);
+	}
+	return mask;
+}
@@ -0,0 +1,35 @@
+#ifndef _STATUS_H_
+#define _STATUS_H_
+
+#include <cstdint>
+
+#include "sysex.h"
+
+/* Status response model: F0 39 03 <payload> F7
+ *
+ * The layout of the payload is not documented, so every payload byte
+ * is a field of its own; the field index is the payload offset.
+ * Subscribed clients get only the changed fields as
+ * F0 7D 10 <index> <value> ... F7
+ * Each client (CLIENT_) has its own subscription.
+ */
+
+#define STATUS_HDR 3                                    // F0 39 03
+#define STATUS_FIELDS (BUF_STATUS_LEN - STATUS_HDR - 1)
+#define STATUS_DELTA_MAX (4 + 2 * STATUS_FIELDS)        // delta message with all fields
+
+struct status_model {
+	uint8_t field[STATUS_FIELDS];
+	uint64_t sub[CLIENTS];  // subscribed fields of each client
+	uint8_t snap;           // CLIENT_BIT of clients getting all subscribed fields next time
+	bool valid;             // field[] holds a previous response
+};
+
+void status_init(struct status_model *m);
+uint64_t status_update(struct status_model *m, const struct sysex_buffer *s);
+int16_t status_delta(const struct status_model *m, uint64_t mask, uint8_t *buf, int16_t size);
+bool status_subscribe(struct status_model *m, uint8_t client, const struct sysex_buffer *s);
+uint64_t status_client_mask(struct status_model *m, uint8_t client, uint64_t changed);
+uint8_t status_subscribers(const struct status_model *m);
+
+#endif
@@ -0,0 +1,163 @@
+#include <cstring>
+
+#include "hal.h"
+#include "sysex.h"
+
+void HAL_RAM_FUNC(buf_clear)(struct sysex_buffer *s)
+{
+	s->pos = 0;
+	s->len = 0;
+	s->invalid_pre = 0;
+	s->invalid_post = 0;
+}
+
+bool HAL_RAM_FUNC(buf_cleared)(struct sysex_buffer *s)
+{
+	return s->pos == 0;
+}
+
+bool HAL_RAM_FUNC(buf_full)(struct sysex_buffer *s)
+{
+	return s->len != 0;
+}
+
+int16_t HAL_RAM_FUNC(buf_append)(struct sysex_buffer *s, uint8_t c)
+{
+	if (s->len) {
+		s->invalid_post++;
+		return RET_ERR_BUF_FULL;
+	}
+
+	if (c == 0xF0) {
+		s->buf[0] = c;
+		s->pos = 1;
+	} else if (s->pos > 0) {
+		if (s->pos >= s->size) {
+			s->pos = 0;
+			return RET_ERR_BUF_OVERFLOW;
+		}
+		s->buf[s->pos] = c;
+		s->pos++;
+
+		if (c == 0xF7) {
+			s->len = s->pos;
+			s->pos = 0;
+			return s->len;
+		}
+	} else {
+		s->invalid_pre++;
+	}
+	return 0;
+}
+
+/* First byte with the high bit set (a status byte), or len.
+ * SysEx payload bytes are 7-bit, so whole words of payload are skipped.
+ */
+static inline uint16_t scan_status(const uint8_t *data, uint16_t i, uint16_t len)
+{
+	uint32_t w;
+
+	while (i < len && ((uintptr_t)(data + i) & 3)) {
+		if (data[i] & 0x80)
+			return i;
+		i++;
+	}
+	while (i + 4 <= len) {
+		memcpy(&w, data + i, 4);
+		if (w & 0x80808080u)
+			break;
+		i += 4;
+	}
+	while (i < len && !(data[i] & 0x80))
+		i++;
+	return i;
+}
+
+/* Append a chunk of bytes, stop right after the first completed message
+ * or when the buffer space is exhausted in the middle of a message.
+ * Returns the number of consumed bytes.
+ *
+ * Same result as buf_append for each byte, but the payload runs between
+ * status bytes are found word by word and copied at once.
+ */
+uint16_t HAL_RAM_FUNC(buf_append_chunk)(struct sysex_buffer *s, const uint8_t *data, uint16_t len)
+{
+	uint16_t i = 0;
+	uint16_t j;
+	uint16_t n;
+	uint8_t c;
+
+	if (s->len) {
+		s->invalid_post += len;
+		return len;
+	}
+
+	while (i < len) {
+		if (s->pos == 0) {
+			/* Outside of a message: skip to F0 */
+			j = i;
+			while ((j = scan_status(data, j, len)) < len && data[j] != 0xF0)
+				j++;
+			s->invalid_pre += j - i;
+			if (j == len)
+				return len;
+
+			s->buf[0] = 0xF0;
+			s->pos = 1;
+			i = j + 1;
+			if (s->pos == s->size)
+				return i;
+			continue;
+		}
+
+		if (s->pos >= s->size) {
+			/* Overflow: the byte is lost, unless it starts a new message */
+			if (data[i] != 0xF0)
+				i++;
+			s->pos = 0;
+			continue;
+		}
+
+		/* Payload run up to the next status byte */
+		j = scan_status(data, i, len);
+		n = j - i;
+		if (n > s->size - s->pos)
+			n = s->size - s->pos;
+		memcpy(s->buf + s->pos, data + i, n);
+		s->pos += n;
+		i += n;
+		if (s->pos == s->size || i == len)
+			return i;
+
+		c = data[i];
+		if (c == 0xF0) {
+			s->pos = 0;
+			continue;
+		}
+		s->buf[s->pos++] = c;
+		i++;
+		if (c == 0xF7) {
+			s->len = s->pos;
+			s->pos = 0;
+			return i;
+		}
+		if (s->pos == s->size)
+			return i;
+	}
+	return len;
+}
+
+bool HAL_RAM_FUNC(is_status_req)(const struct sysex_buffer *s)
+{
+	return s->len == 4 && s->buf[1] == 0x38 && s->buf[2] == 0x03;
+}
+
+bool HAL_RAM_FUNC(is_status_res)(struct sysex_buffer *s)
+{
+	return s->len == BUF_STATUS_LEN && s->buf[1] == 0x39 && s->buf[2] == 0x03;
+}
+
+bool HAL_RAM_FUNC(is_bridge_ctl)(struct sysex_buffer *s)
+{
+	return s->len >= 4 && s->buf[1] == BRIDGE_SYSEX_ID;
+}
@@ -0,0 +1,70 @@
+#ifndef _SYSEX_H_
+#define _SYSEX_H_
+
+#include <cstdint>
+
+#define BUF_LEN 128
+#define BUF_STATUS_LEN 47
+
+/* Messages for the bridge itself, never injected: F0 7D <cmd> ... F7
+ * 0x7D is the SysEx ID for non-commercial use.
+ */
+#define BRIDGE_SYSEX_ID 0x7D
+#define BRIDGE_CMD_DELTA 0x10           // status delta to the client
+#define BRIDGE_CMD_SUBSCRIBE 0x11       // status fields subscription from the client
+#define BRIDGE_CMD_SNAPSHOT 0x12        // send all subscribed fields with the next status
+#define BRIDGE_CMD_MONITOR 0x13         // F0 7D 13 <0/1> F7 : intercepted traffic to the client
+#define BRIDGE_CMD_LOST 0x14            // F0 7D 14 <stream> <seq LE14> <count LE14> F7 : frames lost (bridge to client)
+#define BRIDGE_CMD_UNCACHED 0x20        // F0 7D 20 <request without F0> : inject, bypass the cache
+#define BRIDGE_CMD_RULE 0x40            // F0 7D 40 <idx> <rule> F7 : set (or remove) an interception rule
+#define BRIDGE_CMD_RULES_RESET 0x41     // F0 7D 41 F7 : default interception rules
+
+/* Clients of the bridge, one per host interface */
+#define CLIENT_MIDI 0
+#define CLIENT_RAW 1
+#define CLIENT_NET 2
+#define CLIENTS 3
+#define CLIENT_BIT(c) (1 << (c))
+
+/* Streams of frames to a client, each numbered on its own (14 bits) */
+#define STREAM_RES 0            // responses to the requests of the client
+#define STREAM_DELTA 1          // status deltas
+#define STREAM_MON 2            // intercepted transactions
+#define STREAMS 3
+#define STREAM_NONE 3           // bridge notices (LOST), not numbered
+
+/* Frame header tag on the vendor interface and the network: stream and seq */
+#define FRAME_TAG(stream, seq) ((stream) << 14 | ((seq) & 0x3FFF))
+#define FRAME_TAG_STREAM(tag) ((tag) >> 14)
+#define FRAME_TAG_SEQ(tag) ((tag) & 0x3FFF)
+
+#define RET_ERR_BUF_OVERFLOW    (-32767)
+#define RET_ERR_BUF_FULL        (-32766)
+#define RET_ERR_TIMEOUT         (-32765)
+#define RET_ERR_FORMAT          (-32764)
+
+struct sysex_buffer {
+	uint8_t *buf;
+	int16_t size;           // capacity of buf
+	int16_t pos;
+	int16_t len;
+	int16_t invalid_pre;
+	int16_t invalid_post;
+	uint32_t ts;            // completion time (us)
+	uint8_t clients;        // CLIENT_BIT mask: origin of a request, destinations of a response
+	uint8_t loans;          // ic0: frames of the pair loaned to ijres, ijres: buf is loaned
+	uint8_t act;            // ic: RULE_ actions
+	uint8_t stream;         // ijres: STREAM_ of the frame
+};
+
+void buf_clear(struct sysex_buffer *s);
+bool buf_cleared(struct sysex_buffer *s);
+bool buf_full(struct sysex_buffer *s);
+int16_t buf_append(struct sysex_buffer *s, uint8_t c);
+uint16_t buf_append_chunk(struct sysex_buffer *s, const uint8_t *data, uint16_t len);
+
+bool is_status_req(const struct sysex_buffer *s);
+bool is_status_res(struct sysex_buffer *s);
+bool is_bridge_ctl(struct sysex_buffer *s);
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef _SYSEXQ_H_
+#define _SYSEXQ_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "sysex.h"
+#include "ring.h"
+
+/* SysEx frame queues with a common interface:
+ *
+ * Producer: claim(need) the frame being filled (the same frame is returned
+ * until committed; need is the minimal payload space), grow(s) when the
+ * space is exhausted in the middle of a message, commit() and publish().
+ * Consumer: front() and release().
+ *
+ * sysex_ring keeps fixed BUF_LEN slots, sysex_arena keeps length-prefixed
+ * frames of any size in a byte ring.
+ *
+ * loan(src) commits a frame referring to the payload of src in another
+ * queue instead of a copy. The producer of src must not reuse it until
+ * the consumer of the loan has released it.
+ */
+
+#define SYSEX_ARENA_MIN BUF_LEN // Minimal payload space offered for a frame of unknown length, no grow up to it
+#define SYSEX_ARENA_WRAP (-1)   // Header len of a wrap marker: next frame is at the arena start
+
+template <unsigned N>
+class sysex_ring : public spsc_ring<struct sysex_buffer, N> {
+	typedef spsc_ring<struct sysex_buffer, N> base;
+
+public:
+	sysex_ring()
+	{
+		unsigned i;
+
+		for (i = 0; i < N; i++) {
+			this->slot[i].buf = data[i];
+			this->slot[i].size = BUF_LEN;
+			buf_clear(&this->slot[i]);
+		}
+	}
+
+	struct sysex_buffer *claim(uint16_t need = 0)
+	{
+		struct sysex_buffer *s;
+
+		if (need > BUF_LEN)
+			return nullptr;
+		s = base::claim();
+		if (s && s->loans) {
+			s->buf = data[s - this->slot];
+			s->loans = 0;
+		}
+		return s;
+	}
+
+	struct sysex_buffer *grow(struct sysex_buffer *s)
+	{
+		return s;
+	}
+
+	struct sysex_buffer *loan(const struct sysex_buffer *src)
+	{
+		struct sysex_buffer *s = claim();
+
+		if (!s)
+			return nullptr;
+		s->buf = src->buf;
+		s->len = src->len;
+		s->ts = src->ts;
+		s->loans = 1;
+		base::commit();
+		return s;
+	}
+
+private:
+	uint8_t data[N][BUF_LEN];
+};
+
+/* Each frame is a struct sysex_buffer header followed by the payload.
+ * A frame never wraps around the arena end, so the payload is contiguous.
+ * The offsets are kept in range [0, SIZE], a producer always leaves an
+ * alignment gap before the consumer offset, so wr == rd means empty.
+ */
+template <unsigned SIZE>
+class sysex_arena {
+	static constexpr uint32_t A = alignof(struct sysex_buffer);
+	static constexpr uint32_t HDR = sizeof(struct sysex_buffer);
+
+	static_assert(SIZE % A == 0 && SIZE <= 0x8000, "invalid arena size");
+	static_assert(SIZE >= 2 * (HDR + SYSEX_ARENA_MIN), "arena too small");
+
+public:
+	sysex_arena() : wr(0), rd(0), wr_priv(0), cur(0), claimed(false) {}
+
+	/* Producer side */
+	struct sysex_buffer *claim(uint16_t need = 0)
+	{
+		uint32_t w = wr_priv;
+		uint32_t r = rd.load(std::memory_order_acquire);
+		uint32_t n, start;
+
+		if (claimed) {
+			if (hdr(cur)->size >= need)
+				return hdr(cur);
+			/* Untouched frame with not enough space: claim again */
+			if (hdr(cur)->pos != 0 || hdr(cur)->len != 0)
+				return nullptr;
+			claimed = false;
+		}
+
+		need = need ? need : SYSEX_ARENA_MIN;
+
+		n = run(w, r);
+		if (n < HDR + need && w >= r) {
+			start = r > 0 ? r - A : 0;
+			if (start >= HDR + need) {
+				mark_wrap(w);
+				w = 0;
+				n = start;
+			}
+		}
+		if (n < HDR + need)
+			return nullptr;
+
+		cur = w;
+		claimed = true;
+		init(hdr(w), n);
+		return hdr(w);
+	}
+
+	/* Frame space exhausted: move the partial frame to the arena start,
+	 * if there is more space than at the current position.
+	 */
+	struct sysex_buffer *grow(struct sysex_buffer *s)
+	{
+		uint32_t r = rd.load(std::memory_order_acquire);
+		uint32_t n, start;
+		struct sysex_buffer *d;
+
+		if (!claimed || s != hdr(cur))
+			return s;
+
+		/* Space released by the consumer meanwhile */
+		n = run(cur, r);
+		if (n > HDR + (uint32_t)s->size)
+			s->size = limit(n - HDR);
+		if (s->pos < s->size || cur < r || cur == 0)
+			return s;
+
+		start = r > 0 ? r - A : 0;
+		if (start <= n || start < HDR + (uint32_t)s->pos + 1)
+			return s;
+
+		d = hdr(0);
+		memcpy(mem + HDR, s->buf, s->pos);
+		d->pos = s->pos;
+		d->len = s->len;
+		d->invalid_pre = s->invalid_pre;
+		d->invalid_post = s->invalid_post;
+		d->ts = s->ts;
+		d->clients = s->clients;
+		d->loans = 0;
+		d->buf = mem + HDR;
+		d->size = limit(start - HDR);
+
+		mark_wrap(cur);
+		cur = 0;
+		return d;
+	}
+
+	void commit()
+	{
+		struct sysex_buffer *s = hdr(cur);
+
+		if (!claimed)
+			return;
+		/* The consumer may clear the frame before release, keep its extent in size,
+		 * a loaned frame has the header only
+		 */
+		s->size = s->len > 0 && s->buf == (uint8_t *)s + HDR ? s->len : 0;
+		wr_priv = cur + HDR + align(s->size);
+		claimed = false;
+	}
+
+	/* Header only frame */
+	struct sysex_buffer *loan(const struct sysex_buffer *src)
+	{
+		struct sysex_buffer *s = claim(1);
+
+		if (!s)
+			return nullptr;
+		s->buf = src->buf;
+		s->len = src->len;
+		s->ts = src->ts;
+		s->loans = 1;
+		commit();
+		return s;
+	}
+
+	void publish()
+	{
+		wr.store(wr_priv, std::memory_order_release);
+	}
+
+	/* Consumer side */
+	struct sysex_buffer *front()
+	{
+		uint32_t r = rd.load(std::memory_order_relaxed);
+		uint32_t w = wr.load(std::memory_order_acquire);
+
+		if (r == w)
+			return nullptr;
+
+		if (SIZE - r < HDR || hdr(r)->len == SYSEX_ARENA_WRAP) {
+			r = 0;
+			rd.store(r, std::memory_order_release);
+			if (r == w)
+				return nullptr;
+		}
+		return hdr(r);
+	}
+
+	void release()
+	{
+		uint32_t r = rd.load(std::memory_order_relaxed);
+		struct sysex_buffer *s = hdr(r);
+
+		r += HDR + align(s->size);
+		rd.store(r, std::memory_order_release);
+	}
+
+	uint32_t wr_index() const { return wr.load(std::memory_order_relaxed); }
+	uint32_t rd_index() const { return rd.load(std::memory_order_relaxed); }
+
+	/* Bytes in use, including headers */
+	uint32_t count() const
+	{
+		uint32_t w = wr_index();
+		uint32_t r = rd_index();
+
+		return w >= r ? w - r : SIZE - r + w;
+	}
+	static constexpr unsigned depth() { return SIZE; }
+
+private:
+	alignas(A) uint8_t mem[SIZE];
+
+	std::atomic<uint32_t> wr;
+	std::atomic<uint32_t> rd;
+	uint32_t wr_priv;       // producer only: committed, not yet published
+	uint32_t cur;           // producer only: offset of the claimed frame
+	bool claimed;
+
+	struct sysex_buffer *hdr(uint32_t off)
+	{
+		return (struct sysex_buffer *)(mem + off);
+	}
+
+	static uint32_t align(uint32_t n)
+	{
+		return (n + A - 1) & ~(A - 1);
+	}
+
+	static int16_t limit(uint32_t n)
+	{
+		return n > 0x7FFF ? 0x7FFF : n;
+	}
+
+	/* Contiguous free space at offset w */
+	static uint32_t run(uint32_t w, uint32_t r)
+	{
+		uint32_t n;
+
+		if (w < r)
+			return r - w - A;
+		n = SIZE - w;
+		if (r == 0)
+			n = n > A ? n - A : 0;
+		return n;
+	}
+
+	void mark_wrap(uint32_t w)
+	{
+		if (SIZE - w >= HDR)
+			hdr(w)->len = SYSEX_ARENA_WRAP;
+	}
+
+	void init(struct sysex_buffer *s, uint32_t n)
+	{
+		s->buf = (uint8_t *)s + HDR;
+		s->size = limit(n - HDR);
+		s->loans = 0;
+		buf_clear(s);
+	}
+};
+
+/* Append a chunk of bytes into a claimed frame, grow the frame when needed.
+ * Stops right after a completed message, returns count of consumed bytes.
+ */
+template <class Q>
+uint16_t queue_append_chunk(Q &q, struct sysex_buffer *&s, const uint8_t *data, uint16_t len)
+{
+	uint16_t n = 0;
+
+	while (n < len) {
+		n += buf_append_chunk(s, data + n, len - n);
+		if (buf_full(s))
+			break;
+		if (s->pos == s->size)
+			s = q.grow(s);
+	}
+	return n;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include <cstring>
+
+#include "hal.h"
+#include "trace.h"
+
+void trace_init(struct trace_ring *t)
+{
+	t->wr.store(0, std::memory_order_relaxed);
+	t->rd.store(0, std::memory_order_relaxed);
+	t->dropped = 0;
+	t->dropped_total = 0;
+}
+
+static uint32_t HAL_RAM_FUNC(trace_write)(struct trace_ring *t, uint32_t w, const uint8_t *data, uint32_t len)
+{
+	uint32_t off = w & TRACE_RING_MASK;
+	uint32_t n = TRACE_RING_LEN - off;
+
+	if (!len)
+		return w;
+	if (n > len)
+		n = len;
+	memcpy(t->buf + off, data, n);
+	memcpy(t->buf, data + n, len - n);
+	return w + len;
+}
+
+static bool trace_record(struct trace_ring *t, uint8_t type, uint32_t ts,
+		const uint8_t *d0, uint16_t n0, const uint8_t *d1, uint16_t n1)
+{
+	uint8_t hdr[TRACE_HDR];
+	uint32_t w = t->wr.load(std::memory_order_relaxed);
+	uint32_t r = t->rd.load(std::memory_order_acquire);
+	uint16_t len = n0 + n1;
+
+	if (TRACE_RING_LEN - (w - r) < TRACE_HDR + (uint32_t)len)
+		return false;
+
+	hdr[0] = TRACE_MAGIC;
+	hdr[1] = type;
+	hdr[2] = len;
+	hdr[3] = len >> 8;
+	hdr[4] = ts;
+	hdr[5] = ts >> 8;
+	hdr[6] = ts >> 16;
+	hdr[7] = ts >> 24;
+	w = trace_write(t, w, hdr, TRACE_HDR);
+	w = trace_write(t, w, d0, n0);
+	w = trace_write(t, w, d1, n1);
+	t->wr.store(w, std::memory_order_release);
+	return true;
+}
+
+bool HAL_RAM_FUNC(trace_put2)(struct trace_ring *t, uint8_t type, uint32_t ts,
+		const uint8_t *d0, uint16_t n0, const uint8_t *d1, uint16_t n1)
+{
+	uint8_t d[4];
+
+	/* Report the loss first, so the host sees where the gap is */
+	if (t->dropped) {
+		d[0] = t->dropped;
+		d[1] = t->dropped >> 8;
+		d[2] = t->dropped >> 16;
+		d[3] = t->dropped >> 24;
+		if (!trace_record(t, TRACE_DROP, ts, d, sizeof(d), nullptr, 0)) {
+			t->dropped++;
+			t->dropped_total++;
+			return false;
+		}
+		t->dropped = 0;
+	}
+
+	if (!trace_record(t, type, ts, d0, n0, d1, n1)) {
+		t->dropped++;
+		t->dropped_total++;
+		return false;
+	}
+	return true;
+}
+
+bool trace_put(struct trace_ring *t, uint8_t type, uint32_t ts, const uint8_t *data, uint16_t len)
+{
+	return trace_put2(t, type, ts, data, len, nullptr, 0);
+}
+
+/* Contiguous chunk ready for the host, at most len bytes */
+const uint8_t *trace_peek(struct trace_ring *t, uint32_t *len)
+{
+	uint32_t r = t->rd.load(std::memory_order_relaxed);
+	uint32_t off = r & TRACE_RING_MASK;
+	uint32_t n = t->wr.load(std::memory_order_acquire) - r;
+
+	if (n > TRACE_RING_LEN - off)
+		n = TRACE_RING_LEN - off;
+	if (n < *len)
+		*len = n;
+	return t->buf + off;
+}
+
+void trace_consume(struct trace_ring *t, uint32_t len)
+{
+	t->rd.store(t->rd.load(std::memory_order_relaxed) + len, std::memory_order_release);
+}
@@ -0,0 +1,50 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+
+/* Binary trace stream: records in a byte ring, drained to the host in bulk.
+ *
+ * Record: magic, type, length (LE16), timestamp in us (LE32), payload.
+ * Records may wrap around the ring end, the drain sends contiguous chunks.
+ * Records which do not fit are dropped and counted.
+ * One producer and one consumer, they may run on different cores.
+ * Decoded on the host by host/trace_decode, replayed by host/replay.
+ */
+
+#define TRACE_RING_BITS 13
+#define TRACE_RING_LEN (1u << TRACE_RING_BITS)
+#define TRACE_RING_MASK (TRACE_RING_LEN - 1)
+
+#define TRACE_MAGIC 0xA5
+#define TRACE_HDR 8
+
+#define TRACE_F2M 1             // intercepted request, DSPB to CPB
+#define TRACE_M2F 2             // intercepted response, CPB to DSPB
+#define TRACE_U2M 3             // request from USB-MIDI
+#define TRACE_M2U 4             // message to USB-MIDI
+#define TRACE_ERR 5             // error register changed: err_get() (LE16)
+#define TRACE_DROP 6            // records dropped before this one (LE32)
+#define TRACE_RAW 7             // captured chunk: n bytes of SPI0, then n bytes of SPI1
+#define TRACE_PIN 8             // pins changed: TRACE_PIN_ levels, HAL_MUX_ selects
+
+#define TRACE_PIN_NIRQ1 (1 << 0)        // nIRQ1 from DSPB
+#define TRACE_PIN_NIRQB (1 << 1)        // nIRQ injected to CPB
+
+struct trace_ring {
+	uint8_t buf[TRACE_RING_LEN];
+	std::atomic<uint32_t> wr;       // free running, at a record boundary
+	std::atomic<uint32_t> rd;       // free running
+	uint32_t dropped;               // producer only: not yet reported
+	uint32_t dropped_total;
+};
+
+void trace_init(struct trace_ring *t);
+bool trace_put(struct trace_ring *t, uint8_t type, uint32_t ts, const uint8_t *data, uint16_t len);
+bool trace_put2(struct trace_ring *t, uint8_t type, uint32_t ts,
+		const uint8_t *d0, uint16_t n0, const uint8_t *d1, uint16_t n1);
+const uint8_t *trace_peek(struct trace_ring *t, uint32_t *len);
+void trace_consume(struct trace_ring *t, uint32_t len);
+
+#endif
@@ -17,7 +17,7 @@ extern "C" {
 #define CFG_TUD_CDC_RX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
 #endif
 #ifndef CFG_TUD_CDC_TX_BUFSIZE
-#define CFG_TUD_CDC_TX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
+#define CFG_TUD_CDC_TX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 256)
 #endif
 
 // CDC Endpoint transfer buffer size, more is faster
@@ -25,20 +25,19 @@ extern "C" {
 #define CFG_TUD_CDC_EP_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
 #endif
 
-// We use a vendor specific interface but with our own driver
-// Vendor driver only used for Microsoft OS 2.0 descriptor
-#if !PICO_STDIO_USB_RESET_INTERFACE_SUPPORT_MS_OS_20_DESCRIPTOR
-#define CFG_TUD_VENDOR            (0)
-#else
+// The reset interface is vendor specific but with its own driver,
+// the vendor driver serves the raw SysEx interface
+// (and the Microsoft OS 2.0 descriptor when enabled)
 #define CFG_TUD_VENDOR            (1)
-#define CFG_TUD_VENDOR_RX_BUFSIZE  (256)
-#define CFG_TUD_VENDOR_TX_BUFSIZE  (256)
-#endif
+#define CFG_TUD_VENDOR_RX_BUFSIZE  (512)
+#define CFG_TUD_VENDOR_TX_BUFSIZE  (512)
 
 #define CFG_TUD_MIDI 1
 
-#define CFG_TUD_MIDI_RX_BUFSIZE   (64)
-#define CFG_TUD_MIDI_TX_BUFSIZE   (64)
+// FIFOs of 4-byte event packets; the TX FIFO takes several responses,
+// which go out back to back in full 64-byte packets
+#define CFG_TUD_MIDI_RX_BUFSIZE   (256)
+#define CFG_TUD_MIDI_TX_BUFSIZE   (512)
 
 #ifdef __cplusplus
 }
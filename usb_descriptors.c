@@ -27,9 +27,9 @@
 
 #define TUD_RPI_RESET_DESC_LEN  9
 #if !PICO_STDIO_USB_ENABLE_RESET_VIA_VENDOR_INTERFACE
-#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MIDI_DESC_LEN)
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MIDI_DESC_LEN + TUD_VENDOR_DESC_LEN)
 #else
-#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MIDI_DESC_LEN + TUD_RPI_RESET_DESC_LEN)
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MIDI_DESC_LEN + TUD_VENDOR_DESC_LEN + TUD_RPI_RESET_DESC_LEN)
 #endif
 #if !PICO_STDIO_USB_DEVICE_SELF_POWERED
 #define USBD_CONFIGURATION_DESCRIPTOR_ATTRIBUTE (0)
@@ -41,13 +41,13 @@
 
 #define USBD_ITF_CDC       (0) // needs 2 interfaces
 #if !PICO_STDIO_USB_ENABLE_RESET_VIA_VENDOR_INTERFACE
-#define USBD_ITF_MIDI      (2)
-#define USBD_ITF_MAX       (3)
+#define USBD_ITF_MIDI      (2) // needs 2 interfaces
 #else
 #define USBD_ITF_RPI_RESET (2)
-#define USBD_ITF_MIDI      (3)
-#define USBD_ITF_MAX       (4)
+#define USBD_ITF_MIDI      (3) // needs 2 interfaces
 #endif
+#define USBD_ITF_RAW       (USBD_ITF_MIDI + 2)
+#define USBD_ITF_MAX       (USBD_ITF_RAW + 1)
 
 #define USBD_CDC_EP_CMD (0x81)
 #define USBD_CDC_EP_OUT (0x02)
@@ -59,6 +59,11 @@
 #define USBD_MIDI_EP_IN (0x83)
 #define USBD_MIDI_IN_OUT_MAX_SIZE (64)
 
+// Raw SysEx frames, see hal_raw_read()
+#define USBD_RAW_EP_OUT (0x04)
+#define USBD_RAW_EP_IN (0x84)
+#define USBD_RAW_IN_OUT_MAX_SIZE (64)
+
 #define USBD_STR_0 (0x00)
 #define USBD_STR_MANUF (0x01)
 #define USBD_STR_PRODUCT (0x02)
@@ -66,6 +71,7 @@
 #define USBD_STR_CDC (0x04)
 #define USBD_STR_RPI_RESET (0x05)
 #define USBD_STR_MIDI (0x06)
+#define USBD_STR_RAW (0x07)
 
 // Note: descriptors returned from callbacks must exist long enough for transfer to complete
 
@@ -110,6 +116,9 @@ static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
 #endif
     TUD_MIDI_DESCRIPTOR(USBD_ITF_MIDI, USBD_STR_MIDI,
         USBD_MIDI_EP_OUT, USBD_MIDI_EP_IN, USBD_MIDI_IN_OUT_MAX_SIZE),
+
+    TUD_VENDOR_DESCRIPTOR(USBD_ITF_RAW, USBD_STR_RAW,
+        USBD_RAW_EP_OUT, USBD_RAW_EP_IN, USBD_RAW_IN_OUT_MAX_SIZE),
 };
 
 static char usbd_serial_str[PICO_UNIQUE_BOARD_ID_SIZE_BYTES * 2 + 1];
@@ -120,6 +129,7 @@ static const char *const usbd_desc_str[] = {
     [USBD_STR_SERIAL] = usbd_serial_str,
     [USBD_STR_CDC] = "Board CDC",
     [USBD_STR_MIDI] = "SL1602 SPI-MIDI",
+    [USBD_STR_RAW] = "SL1602 SysEx",
 #if PICO_STDIO_USB_ENABLE_RESET_VIA_VENDOR_INTERFACE
     [USBD_STR_RPI_RESET] = "Reset",
 #endif